@@ -9,6 +9,22 @@
 
 #include <stdexcept>
 
+#include <algorithm>
+
+#include <queue>
+
+#include <chrono>
+
+#include <thread>
+
+#include <atomic>
+
+// vektoriytimet vain x86-64:lle, jossa SSE2 kuuluu perusarkkitehtuuriin
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define POLYGON_SIMD 1
+#endif
+
 std::minstd_rand rand_engine; // Reasonably quick pseudo-random generator
 
 template <typename Type>
@@ -22,12 +38,136 @@ Type random_in_range(Type start, Type end)
     return static_cast<Type>(start+num);
 }
 
+namespace {
+
+// Ristiinlaskentaytimet (crossing number): reunat (x[i], y[i]) -> (x[i + 1], y[i + 1]),
+// i < edges. Piste on sisällä, jos oikealle lähtevä säde leikkaa parittoman
+// määrän reunoja. Vain pisteen korkeuden ylittävät reunat voivat leikata, ja
+// niitä on tyypillisesti muutama, joten vektoriytimet etsivät ne kokonaisluku-
+// vertailuilla usealta reunalta kerralla ja tarkka testi tehdään vain niille.
+
+// leikkaako pisteen korkeuden ylittävä reuna i säteen: leikkauspisteen
+// vertailu kerrotaan ristiin jakolaskun sijaan, joten tulos on tarkka
+inline bool crosses_ray(int const* xs, int const* ys, size_t i, Coord xy)
+{
+    long long int ax = xs[i], ay = ys[i], bx = xs[i + 1], by = ys[i + 1];
+    // xy.x < ax + (xy.y - ay) * (bx - ax) / (by - ay)
+    long long int lhs = (xy.x - ax) * (by - ay);
+    long long int rhs = (xy.y - ay) * (bx - ax);
+    return by > ay ? lhs < rhs : lhs > rhs;
+}
+
+bool crossings_scalar(int const* xs, int const* ys, size_t edges, Coord xy)
+{
+    bool inside = false;
+    for(size_t i = 0; i < edges; ++i){
+        if((ys[i] > xy.y) != (ys[i + 1] > xy.y) and crosses_ray(xs, ys, i, xy)){
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+#ifdef POLYGON_SIMD
+// neljä reunaa kerrallaan, SSE2 on aina käytettävissä x86-64:ssä
+bool crossings_sse2(int const* xs, int const* ys, size_t edges, Coord xy)
+{
+    __m128i const py = _mm_set1_epi32(xy.y);
+    bool inside = false;
+    size_t i = 0;
+    for(; i + 4 <= edges; i += 4){
+        __m128i above = _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(ys + i)), py);
+        __m128i next_above = _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(ys + i + 1)), py);
+        unsigned int straddle = _mm_movemask_ps(_mm_castsi128_ps(_mm_xor_si128(above, next_above)));
+        for(; straddle != 0; straddle &= straddle - 1){
+            inside ^= crosses_ray(xs, ys, i + __builtin_ctz(straddle), xy);
+        }
+    }
+    return inside != crossings_scalar(xs + i, ys + i, edges - i, xy);
+}
+
+// kahdeksan reunaa kerrallaan, käännetään AVX2:lle ja valitaan ajonaikaisesti
+__attribute__((target("avx2")))
+bool crossings_avx2(int const* xs, int const* ys, size_t edges, Coord xy)
+{
+    __m256i const py = _mm256_set1_epi32(xy.y);
+    bool inside = false;
+    size_t i = 0;
+    for(; i + 8 <= edges; i += 8){
+        __m256i above = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(ys + i)), py);
+        __m256i next_above = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(ys + i + 1)), py);
+        unsigned int straddle = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_xor_si256(above, next_above)));
+        for(; straddle != 0; straddle &= straddle - 1){
+            inside ^= crosses_ray(xs, ys, i + __builtin_ctz(straddle), xy);
+        }
+    }
+    return inside != crossings_scalar(xs + i, ys + i, edges - i, xy);
+}
+#endif
+
+using CrossingKernel = bool (*)(int const*, int const*, size_t, Coord);
+
+// käytettävissä olevat ytimet, nopein viimeisenä
+std::vector<std::pair<std::string, CrossingKernel>> crossing_kernels()
+{
+    std::vector<std::pair<std::string, CrossingKernel>> kernels{ { "scalar", crossings_scalar } };
+#ifdef POLYGON_SIMD
+    kernels.push_back( { "sse2", crossings_sse2 } );
+    if(__builtin_cpu_supports("avx2")){
+        kernels.push_back( { "avx2", crossings_avx2 } );
+    }
+#endif
+    return kernels;
+}
+
+// Kärkien pakkaus: etumerkillinen luku zigzag-koodataan (0, -1, 1, -2, ... ->
+// 0, 1, 2, 3, ...) ja kirjoitetaan 7 bittiä tavua kohden, ylin bitti kertoo
+// jatkuuko luku seuraavaan tavuun.
+void append_varint(std::pmr::vector<std::uint8_t>& bytes, long long int value)
+{
+    unsigned long long int zigzag = (static_cast<unsigned long long int>(value) << 1) ^
+            static_cast<unsigned long long int>(value >> 63);
+    while(zigzag >= 0x80){
+        bytes.push_back(static_cast<std::uint8_t>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    bytes.push_back(static_cast<std::uint8_t>(zigzag));
+}
+
+// lukee append_varint:n kirjoittaman luvun ja siirtää osoittimen sen yli
+inline long long int read_varint(std::uint8_t const*& bytes)
+{
+    unsigned long long int zigzag = 0;
+    for(int shift = 0; ; shift += 7){
+        std::uint8_t byte = *bytes++;
+        zigzag |= static_cast<unsigned long long int>(byte & 0x7f) << shift;
+        if(byte < 0x80){
+            break;
+        }
+    }
+    return static_cast<long long int>(zigzag >> 1) ^ -static_cast<long long int>(zigzag & 1);
+}
+
+} // namespace
+
 // Modify the code below to implement the functionality of the class.
 // Also remove comments from the parameter names when you implement
 // an operation (Commenting out parameter name prevents compiler from
 // warning about unused parameters on operations you haven't yet implemented.)
 
-Datastructures::Datastructures(): stations()
+Datastructures::Datastructures():
+    stations(&pool), vec_all_stations(&pool),
+    station_coords(&pool), station_names(&pool), station_regions(&pool), station_region_slots(&pool), station_auto_regions(&pool),
+    station_departures(&pool), station_pending_departures(&pool),
+    departure_buckets(MINUTES_PER_DAY, &pool), train_stops(&pool),
+    connections(&pool), trip_numbers(&pool), trip_ids(&pool), free_trips(&pool), dirty_trains(&pool),
+    graph_offsets(&pool), graph_edges(&pool), graph_has_incoming(&pool),
+    station_ids(&pool), station_index(&pool),
+    station_kd_nodes(&pool), free_handles(&pool),
+    stations_by_name(&pool), stations_by_distance(&pool), stations_by_coord(&pool),
+    kd_nodes(&pool), regions(&pool), vec_all_regions(&pool),
+    rtree_nodes(&pool), rtree_regions(&pool),
+    polygon_bytes(&pool), polygon_x(&pool), polygon_y(&pool), region_coords_buffer(&pool), region_order(&pool)
 {
 
     // Write any initialization you need here
@@ -51,12 +191,69 @@ unsigned int Datastructures::station_count()
 
 /**
  * @brief Datastructures::clear_all
- * poistaa kaikki tallennetut asemat
+ * poistaa kaikki tallennetut asemat ja alueet, säiliöt korvataan
+ * tyhjillä, jotta niiden puskurit palautuvat pooliin, minkä jälkeen
+ * poolin muisti vapautetaan kerralla. Asemapaikkojen sukupolvet säilytetään,
+ * jotta ennen tyhjennystä annetut kahvat eivät osu uusiin asemiin
  */
 void Datastructures::clear_all()
 {
-    stations.clear();
-    vec_all_stations.clear();
+    stations = decltype(stations)(&pool);
+    vec_all_stations = decltype(vec_all_stations)(&pool);
+    station_coords = decltype(station_coords)(&pool);
+    station_names = decltype(station_names)(&pool);
+    station_regions = decltype(station_regions)(&pool);
+    station_region_slots = decltype(station_region_slots)(&pool);
+    station_auto_regions = decltype(station_auto_regions)(&pool);
+    station_departures = decltype(station_departures)(&pool);
+    station_pending_departures = decltype(station_pending_departures)(&pool);
+    station_ids = decltype(station_ids)(&pool);
+    station_index = decltype(station_index)(&pool);
+    station_kd_nodes = decltype(station_kd_nodes)(&pool);
+    free_handles = decltype(free_handles)(&pool);
+    // kaikkien paikkojen sukupolvi vaihtuu, jolloin ennen tyhjennystä
+    // annetut kahvat eivät kelpaa uudelleen käytetyille paikoille
+    for(std::uint8_t& generation : station_generations){
+        if(generation != RETIRED_GENERATION){
+            ++generation;
+        }
+    }
+    stations_by_name = decltype(stations_by_name)(&pool);
+    stations_by_distance = decltype(stations_by_distance)(&pool);
+    stations_by_coord = decltype(stations_by_coord)(&pool);
+    kd_nodes = decltype(kd_nodes)(&pool);
+    kd_root = -1;
+    kd_removed = 0;
+    departure_buckets = decltype(departure_buckets)(&pool);
+    train_stops = decltype(train_stops)(&pool);
+    connections = decltype(connections)(&pool);
+    trip_numbers = decltype(trip_numbers)(&pool);
+    trip_ids = decltype(trip_ids)(&pool);
+    free_trips = decltype(free_trips)(&pool);
+    dirty_trains = decltype(dirty_trains)(&pool);
+    graph_offsets = decltype(graph_offsets)(&pool);
+    graph_edges = decltype(graph_edges)(&pool);
+    graph_has_incoming = decltype(graph_has_incoming)(&pool);
+    graph_dirty = true;
+    hierarchy = RouteHierarchy();
+    regions = decltype(regions)(&pool);
+    vec_all_regions = decltype(vec_all_regions)(&pool);
+    rtree_nodes = decltype(rtree_nodes)(&pool);
+    rtree_regions = decltype(rtree_regions)(&pool);
+    rtree_dirty = false;
+    polygon_bytes = decltype(polygon_bytes)(&pool);
+    polygon_x = decltype(polygon_x)(&pool);
+    polygon_y = decltype(polygon_y)(&pool);
+    polygon_cached_regions = 0;
+    region_coords_buffer = decltype(region_coords_buffer)(&pool);
+    ++region_coords_epoch;
+    region_order = decltype(region_order)(&pool);
+    region_order_dirty = false;
+    ++epoch;
+
+    pool.release();
+    // minuuttikorit luodaan vasta vapautuksen jälkeen, koska ne varataan poolista
+    departure_buckets.resize(MINUTES_PER_DAY);
 }
 
 /**
@@ -66,7 +263,7 @@ void Datastructures::clear_all()
  */
 std::vector<StationID> Datastructures::all_stations()
 {
-    return vec_all_stations;
+    return {vec_all_stations.begin(), vec_all_stations.end()};
 }
 
 /**
@@ -81,14 +278,54 @@ std::vector<StationID> Datastructures::all_stations()
  */
 bool Datastructures::add_station(StationID id, const Name& name, Coord xy)
 {
-    if(stationExists(id)){
+    auto inserted = stations.insert( { id, NO_STATION_HANDLE } );
+    if(!inserted.second){
         return false;
     }
 
-    shared_ptr<StationInfo> newStation = make_shared<StationInfo>(name, xy);
-    stations.insert( { id, newStation } );
+    // otetaan vapautunut paikka uudelleen käyttöön tai lisätään sarakkeisiin rivi
+    StationHandle station;
+    if(!free_handles.empty()){
+        station = free_handles.back();
+        free_handles.pop_back();
+    } else {
+        // clear_all:n jälkeen eläkkeelle jääneet paikat jäävät tyhjiksi riveiksi
+        do {
+            if(station_ids.size() >= HANDLE_INDEX_MASK){
+                // paikat eivät mahdu kahvan HANDLE_INDEX_BITS bittiin
+                stations.erase(inserted.first);
+                return false;
+            }
+            station = station_ids.size();
+            station_coords.push_back(NO_COORD);
+            station_names.emplace_back();
+            station_regions.push_back(NO_REGION);
+            station_region_slots.push_back(NO_INDEX);
+            station_auto_regions.push_back(false);
+            station_departures.emplace_back();
+            station_pending_departures.emplace_back();
+            station_ids.emplace_back();
+            station_index.push_back(NO_INDEX);
+            station_kd_nodes.push_back(-1);
+        } while(station < station_generations.size() and station_generations[station] == RETIRED_GENERATION);
+        if(station == station_generations.size()){
+            station_generations.push_back(0);
+        }
+    }
+    station_coords[station] = xy;
+    station_names[station] = name;
+    station_regions[station] = NO_REGION;
+    station_auto_regions[station] = false;
+    station_ids[station] = id;
+    station_index[station] = vec_all_stations.size();
+    inserted.first->second = station;
 
     vec_all_stations.push_back(id);
+    ++epoch;
+    stations_by_name.insert( { name, id } );
+    stations_by_distance.insert(distance_key(xy, id));
+    stations_by_coord.insert( { xy, station } );
+    kd_insert(station, xy);
 
     return true;
 }
@@ -103,11 +340,7 @@ bool Datastructures::add_station(StationID id, const Name& name, Coord xy)
  */
 Name Datastructures::get_station_name(StationID id)
 {
-    if(stationExists(id)){
-        return stations.at(id)->stationName;
-    }
-    return NO_NAME;
-
+    return get_station_name(find_station(id));
 }
 
 /**
@@ -120,24 +353,192 @@ Name Datastructures::get_station_name(StationID id)
  */
 Coord Datastructures::get_station_coordinates(StationID id)
 {
-    if(stationExists(id)){
-        return stations.at(id)->stationCoord;
+    return get_station_coordinates(find_station(id));
+}
+
+/**
+ * @brief Datastructures::all_stations_view
+ * palauttaa näkymän vec_all_stations -vektoriin kopioimatta sitä
+ * @return näkymä kaikkien asemien id:ihin
+ */
+ConstView<StationID> Datastructures::all_stations_view()
+{
+    return {vec_all_stations.data(), vec_all_stations.size(), &epoch};
+}
+
+/**
+ * @brief Datastructures::all_regions_view
+ * palauttaa näkymän vec_all_regions -vektoriin kopioimatta sitä
+ * @return näkymä kaikkien alueiden id:ihin
+ */
+ConstView<RegionID> Datastructures::all_regions_view()
+{
+    return {vec_all_regions.data(), vec_all_regions.size(), &epoch};
+}
+
+/**
+ * @brief Datastructures::region_coords_view
+ * purkaa alueen koordinaatit yhteiseen puskuriin ja palauttaa näkymän siihen,
+ * näkymä vanhenee seuraavassa region_coords_view-kutsussa
+ * @param id alueen id
+ * @return näkymä alueen koordinaatteihin, tyhjä jos aluetta ei ole
+ */
+ConstView<Coord> Datastructures::region_coords_view(RegionID id)
+{
+    ++region_coords_epoch;
+    region_coords_buffer.clear();
+    auto it = regions.find(id);
+    if(it == regions.end()){
+        return {nullptr, 0, &region_coords_epoch};
+    }
+    decode_polygon(*it->second, [this](Coord xy){ region_coords_buffer.push_back(xy); });
+    return {region_coords_buffer.data(), region_coords_buffer.size(), &region_coords_epoch};
+}
+
+/**
+ * @brief Datastructures::all_stations
+ * kopioi kaikkien asemien id:t kutsujan vektoriin
+ * @param out vektori, jonka sisältö korvataan
+ */
+void Datastructures::all_stations(std::vector<StationID>& out)
+{
+    out.assign(vec_all_stations.begin(), vec_all_stations.end());
+}
+
+/**
+ * @brief Datastructures::all_regions
+ * kopioi kaikkien alueiden id:t kutsujan vektoriin
+ * @param out vektori, jonka sisältö korvataan
+ */
+void Datastructures::all_regions(std::vector<RegionID>& out)
+{
+    out.assign(vec_all_regions.begin(), vec_all_regions.end());
+}
+
+/**
+ * @brief Datastructures::get_region_coords
+ * kopioi alueen koordinaatit kutsujan vektoriin
+ * @param id alueen id
+ * @param out vektori, jonka sisältö korvataan
+ * @return false, jos aluetta ei ole olemassa (out tyhjennetään)
+ */
+bool Datastructures::get_region_coords(RegionID id, std::vector<Coord>& out)
+{
+    auto it = regions.find(id);
+    if(it == regions.end()){
+        out.clear();
+        return false;
+    }
+    out.clear();
+    out.reserve(it->second->vertexCount);
+    decode_polygon(*it->second, [&out](Coord xy){ out.push_back(xy); });
+    return true;
+}
+
+/**
+ * @brief Datastructures::all_subregions_of_region
+ * kopioi alueen kaikki alialueet kutsujan vektoriin
+ * @param id alueen id
+ * @param out vektori, jonka sisältö korvataan
+ * @return false, jos aluetta ei ole olemassa (out tyhjennetään)
+ */
+bool Datastructures::all_subregions_of_region(RegionID id, std::vector<RegionID>& out)
+{
+    auto it = regions.find(id);
+    if(it == regions.end()){
+        out.clear();
+        return false;
+    }
+    update_region_order();
+    RegionInfo const& region = *it->second;
+    out.assign(region_order.begin() + region.subtreeBegin + 1, region_order.begin() + region.subtreeEnd);
+    return true;
+}
+
+/**
+ * @brief Datastructures::all_subregions_view
+ * palauttaa näkymän alueen alialueisiin kopioimatta niitä
+ * @param id alueen id
+ * @return näkymä alueen kaikkiin alialueisiin, tyhjä jos aluetta ei ole
+ */
+ConstView<RegionID> Datastructures::all_subregions_view(RegionID id)
+{
+    auto it = regions.find(id);
+    if(it == regions.end()){
+        return {nullptr, 0, &epoch};
+    }
+    update_region_order();
+    RegionInfo const& region = *it->second;
+    return {region_order.data() + region.subtreeBegin + 1, region.subtreeEnd - region.subtreeBegin - 1, &epoch};
+}
+
+/**
+ * @brief Datastructures::station_handle
+ * hakee aseman kahvan, jota voi käyttää id:n sijaan
+ * kahvan ottavissa operaatioissa
+ * @param id aseman id
+ * @return aseman kahva, NO_STATION_HANDLE jos asemaa ei ole olemassa
+ */
+StationHandle Datastructures::station_handle(StationID const& id)
+{
+    return find_station(id);
+}
+
+/**
+ * @brief Datastructures::station_id
+ * palauttaa kahvaa vastaavan aseman id:n
+ * @param handle aseman kahva
+ * @return aseman id, NO_STATION jos kahva ei vastaa asemaa
+ */
+StationID Datastructures::station_id(StationHandle handle)
+{
+    if(!valid_station(handle)){
+        return NO_STATION;
+    }
+    return station_ids[handle_slot(handle)];
+}
+
+/**
+ * @brief Datastructures::get_station_name
+ * palauttaa kahvaa vastaavan aseman nimen
+ * @param handle aseman kahva
+ * @return aseman nimi, NO_NAME jos asemaa ei ole olemassa
+ */
+Name Datastructures::get_station_name(StationHandle handle)
+{
+    if(!valid_station(handle)){
+        return NO_NAME;
+    }
+    return station_names[handle_slot(handle)];
+}
+
+/**
+ * @brief Datastructures::get_station_coordinates
+ * palauttaa kahvaa vastaavan aseman koordinaatit
+ * @param handle aseman kahva
+ * @return aseman koordinaatit, NO_COORD jos asemaa ei ole olemassa
+ */
+Coord Datastructures::get_station_coordinates(StationHandle handle)
+{
+    if(!valid_station(handle)){
+        return NO_COORD;
     }
-    return NO_COORD;
+    return station_coords[handle_slot(handle)];
 }
 
 /**
  * @brief Datastructures::stations_alphabetically
- * järjestää vec_all_stations id:t asemien nimien
- * akkoosjärjestyksen perusteella
+ * kopioi asemien id:t stations_by_name -joukosta, joka pidetään
+ * valmiiksi nimien mukaisessa aakkosjärjestyksessä
  * @return vectori, jossa asemien id:t asemien nimen mukaan akkosjärj.
  */
 std::vector<StationID> Datastructures::stations_alphabetically()
 {
-    vector<StationID> vec = vec_all_stations;
-    unordered_map<StationID, shared_ptr<StationInfo>> map = stations;
-    sort(vec.begin(), vec.end(), [map](StationID i, StationID j)
-        {return map.at(i)->stationName < map.at(j)->stationName;});
+    vector<StationID> vec;
+    vec.reserve(stations_by_name.size());
+    for(auto it = stations_by_name.begin(); it != stations_by_name.end(); ++it){
+        vec.push_back(it->second);
+    }
 
     return vec;
 
@@ -145,41 +546,42 @@ std::vector<StationID> Datastructures::stations_alphabetically()
 
 /**
  * @brief Datastructures::stations_distance_increasing
- * järjestää vec_all_stations id:t asemien koordinaattien perusteella
- * matka origosta järjestykseen, pienin matka ensin, jos matka on sama, niin
- * y-koordinaatin mukaan järjestykseessä, pienin arvo ensin
+ * kopioi asemien id:t stations_by_distance -joukosta, joka pidetään
+ * valmiiksi järjestyksessä: matka origosta, pienin matka ensin, jos matka
+ * on sama, niin y-koordinaatin mukaan järjestyksessä, pienin arvo ensin
  * @return vectori, jossa asemien id:t asemien koordinaattien mukaan järj.
  */
 std::vector<StationID> Datastructures::stations_distance_increasing()
 {
-    vector<StationID> vec = vec_all_stations;
-    unordered_map<StationID, shared_ptr<StationInfo>> map = stations;
-    sort(vec.begin(), vec.end(), [map](StationID i, StationID j)
-        {if (sqrt(pow(map.at(j)->stationCoord.x,2) + pow(map.at(j)->stationCoord.y,2)) ==
-             sqrt(pow(map.at(i)->stationCoord.x,2) + pow(map.at(i)->stationCoord.y,2))){
-            return map.at(i)->stationCoord.y < map.at(j)->stationCoord.y;
-        }
-        return sqrt(pow(map.at(i)->stationCoord.x,2) + pow(map.at(i)->stationCoord.y,2)) <
-               sqrt(pow(map.at(j)->stationCoord.x,2) + pow(map.at(j)->stationCoord.y,2));});
+    vector<StationID> vec;
+    vec.reserve(stations_by_distance.size());
+    for(auto it = stations_by_distance.begin(); it != stations_by_distance.end(); ++it){
+        vec.push_back(get<2>(*it));
+    }
 
     return vec;
 }
 
 /**
  * @brief Datastructures::find_station_with_coord
- * etsii koordinaattia vastaavan aseman
+ * etsii koordinaattia vastaavan aseman stations_by_coord -hajautustaulusta
  * @param xy koordinaatti jonka asema halutaan
- * @return aseman id, jolla on annettu koordinaatti,
- * NO_STATION, jos asemaa ei ole
+ * @return aseman id, jolla on annettu koordinaatti (pienin id, jos
+ * asemia on useita), NO_STATION, jos asemaa ei ole
  */
 StationID Datastructures::find_station_with_coord(Coord xy)
 {
-    for(auto it = stations.begin(); it != stations.end(); ++it){
-        if(it->second->stationCoord == xy){
-            return it->first;
+    auto range = stations_by_coord.equal_range(xy);
+    if(range.first == range.second){
+        return NO_STATION;
+    }
+    StationID const* found = &station_ids[range.first->second];
+    for(auto it = range.first; it != range.second; ++it){
+        if(station_ids[it->second] < *found){
+            found = &station_ids[it->second];
         }
     }
-    return NO_STATION;
+    return *found;
 }
 
 /**
@@ -192,8 +594,47 @@ StationID Datastructures::find_station_with_coord(Coord xy)
  */
 bool Datastructures::change_station_coord(StationID id, Coord newcoord)
 {
-    if(stationExists(id)){
-        stations.at(id)->stationCoord = newcoord;
+    return change_station_coord(find_station(id), newcoord);
+}
+
+/**
+ * @brief Datastructures::change_station_coord
+ * vaihtaa kahvaa vastaavan aseman koordinaatin
+ * @param handle aseman kahva
+ * @param newcoord uusi aseman koordinaatti
+ * @return true, jos vaihto onnistuu (asema on olemassa)
+ * false, muuten
+ */
+bool Datastructures::change_station_coord(StationHandle handle, Coord newcoord)
+{
+    if(valid_station(handle)){
+        StationHandle station = handle_slot(handle);
+        StationID const& id = station_ids[station];
+        Coord& coord = station_coords[station];
+        stations_by_distance.erase(distance_key(coord, id));
+        erase_coord_index(coord, station);
+        coord = newcoord;
+        stations_by_distance.insert(distance_key(newcoord, id));
+        stations_by_coord.insert( { newcoord, station } );
+        kd_remove(station);
+        kd_insert(station, newcoord);
+        // kaarten pituudet muuttuvat vain, jos asema on jonkin junan pysähdys
+        if(!station_departures[station].empty() or !station_pending_departures[station].empty()){
+            graph_dirty = true;
+        }
+
+        // automaattisesti liitetty asema seuraa rajojen yli
+        if(station_auto_regions[station]){
+            update_rtree();
+            RegionInfo* region = smallest_region_containing(newcoord);
+            RegionID regionid = region ? region->regionId : NO_REGION;
+            if(regionid != station_regions[station]){
+                detach_station_from_region(station);
+                if(region){
+                    attach_station_to_region(station, regionid, true);
+                }
+            }
+        }
         return true;
     }
 
@@ -212,18 +653,39 @@ bool Datastructures::change_station_coord(StationID id, Coord newcoord)
  */
 bool Datastructures::add_departure(StationID stationid, TrainID trainid, Time time)
 {
-    try{
-        stations.at(stationid)->departures.at(time).insert(trainid);
+    return add_departure(find_station(stationid), trainid, time);
+}
+
+/**
+ * @brief Datastructures::add_departure
+ * lisää kahvaa vastaavalle asemalle lähtevän junan
+ * @param handle aseman kahva
+ * @param trainid junan id, joka lähtee asemalta
+ * @param time aika, jolloin juna lähtee
+ * @return true, jos lisäys onnistuu (asema on olemassa)
+ * false, jos asemaa ei ole tai aika ei ole kelvollinen HHMM-aika
+ */
+bool Datastructures::add_departure(StationHandle handle, TrainID const& trainid, Time time)
+{
+    if(!valid_station(handle) or minute_of_day(time) < 0){
+        return false;
+    }
+    StationHandle station = handle_slot(handle);
+    Departure departure = {time, trainid};
+    if(has_departure(station, departure)){
         return true;
-    } catch(const out_of_range& oor1){
-        try{
-            stations.at(stationid)->departures[time] = {};
-            stations.at(stationid)->departures.at(time).insert(trainid);
-            return true;
-        } catch(const out_of_range& oor2){
-            return false;
-        }
     }
+
+    departure_buckets[minute_of_day(time)].push_back( { station, trainid } );
+    add_train_stop(trainid, { time, station });
+
+    pmr::vector<Departure>& pending = station_pending_departures[station];
+    pending.push_back(departure);
+    if(pending.size() >= DEPARTURE_BATCH){
+        merge_departures(station);
+    }
+    add_region_totals(station_regions[station], 0, 1);
+    return true;
 }
 
 /**
@@ -237,13 +699,47 @@ bool Datastructures::add_departure(StationID stationid, TrainID trainid, Time ti
  */
 bool Datastructures::remove_departure(StationID stationid, TrainID trainid, Time time)
 {
-    try{
-        stations.at(stationid)->departures.at(time).erase(trainid);
+    return remove_departure(find_station(stationid), trainid, time);
+}
+
+/**
+ * @brief Datastructures::remove_departure
+ * poistaa junan lähdön kahvaa vastaavalta asemalta
+ * @param handle aseman kahva
+ * @param trainid juna jonka lähtö poistetaan
+ * @param time aika jolloin poistettava juna lähtee asemalta
+ * @return true, jos poisto onnistui (asema on olemassa, juna lähtee asemalta annettuna aikana)
+ * false, muuten
+ */
+bool Datastructures::remove_departure(StationHandle handle, TrainID const& trainid, Time time)
+{
+    if(!valid_station(handle)){
+        return false;
+    }
+    StationHandle station = handle_slot(handle);
+    Departure departure = {time, trainid};
+
+    pmr::vector<Departure>& pending = station_pending_departures[station];
+    auto pt = find(pending.begin(), pending.end(), departure);
+    if(pt != pending.end()){
+        *pt = std::move(pending.back());
+        pending.pop_back();
+        erase_from_bucket(station, departure);
+        erase_train_stop(trainid, { time, station });
+        add_region_totals(station_regions[station], 0, -1);
         return true;
     }
-    catch(const out_of_range& oor) {
+
+    pmr::vector<Departure>& departures = station_departures[station];
+    auto it = lower_bound(departures.begin(), departures.end(), departure);
+    if(it == departures.end() or *it != departure){
         return false;
     }
+    departures.erase(it);
+    erase_from_bucket(station, departure);
+    erase_train_stop(trainid, { time, station });
+    add_region_totals(station_regions[station], 0, -1);
+    return true;
 
 }
 
@@ -257,120 +753,612 @@ bool Datastructures::remove_departure(StationID stationid, TrainID trainid, Time
  */
 std::vector<std::pair<Time, TrainID>> Datastructures::station_departures_after(StationID stationid, Time time)
 {
-    if(!stationExists(stationid)){
+    return station_departures_after(find_station(stationid), time);
+}
+
+/**
+ * @brief Datastructures::station_departures_after
+ * etsii kaikki lähdöt kahvaa vastaavalta asemalta annetulla kellonajalla ja sen jälkeen
+ * @param handle aseman kahva
+ * @param time aika, jolloin, ja jonka jälkeen lähdöt halutaan
+ * @return vectori jossa pari joka kertoo: junan lähtöajan ja junan id:n,
+ * jos asemaa ei ole olemassa {{NO_TIME, NO_TRAIN}}
+ */
+std::vector<std::pair<Time, TrainID>> Datastructures::station_departures_after(StationHandle handle, Time time)
+{
+    if(!valid_station(handle)){
         return {{NO_TIME, NO_TRAIN}};
     }
-    map<Time, set<TrainID>> dep_info = stations.at(stationid)->departures;
-    vector<pair<Time, TrainID>> vec;
+    StationHandle station = handle_slot(handle);
+    merge_departures(station);
+    pmr::vector<Departure> const& departures = station_departures[station];
 
-    for(auto it = dep_info.begin(); it != dep_info.end(); ++it){
-        if(it->first >= time){
-            for(auto j = it->second.begin(); j != it->second.end(); ++j){
-                vec.push_back(pair{it->first, *j});
-            }
-        }
-    }
-    return vec;
+    // ensimmäinen lähtö, jonka aika on vähintään time (tyhjä id on pienin)
+    auto it = lower_bound(departures.begin(), departures.end(), Departure{time, TrainID()});
+    return {it, departures.end()};
 }
 
 /**
- * @brief Datastructures::add_region
- * lisää alueen tietorakenteeseen
- * regions ja vec_all_regions
- * @param id alueen id
- * @param name alueen nimi
- * @param coords alueen rajojen koordinaatit
- * @return false, jos alue on jo olemassa
- * true, lisäys onnistuu, alue ei ollut vielä olemassa
+ * @brief Datastructures::departures_between
+ * hakee koko verkon lähdöt aikaväliltä minuuttikoreista
+ * @param from aikavälin alku (mukaan lukien)
+ * @param to aikavälin loppu (mukaan lukien)
+ * @return vectori (aika, asema, juna) -kolmikoita ajan, aseman ja junan
+ * mukaan järjestyksessä, tyhjä jos aikaväli ei ole kelvollinen
  */
-bool Datastructures::add_region(RegionID id, const Name &name, std::vector<Coord> coords)
+std::vector<std::tuple<Time, StationID, TrainID>> Datastructures::departures_between(Time from, Time to)
 {
-    if(regionExists(id)){
-        return false;
+    vector<tuple<Time, StationID, TrainID>> vec;
+    int first = minute_of_day(from);
+    int last = minute_of_day(to);
+    if(first < 0 or last < 0){
+        return vec;
     }
 
-    shared_ptr<RegionInfo> newRegion = make_shared<RegionInfo>(name, coords);
-    regions.insert( { id, newRegion } );
-
-    vec_all_regions.push_back(id);
-
-    return true;
-
+    for(int minute = first; minute <= last; ++minute){
+        Time time = (minute / 60) * 100 + minute % 60;
+        size_t bucket_start = vec.size();
+        for(auto const& [station, trainid] : departure_buckets[minute]){
+            vec.push_back( { time, station_ids[station], trainid } );
+        }
+        sort(vec.begin() + bucket_start, vec.end());
+    }
+    return vec;
 }
 
 /**
- * @brief Datastructures::all_regions
- * palauttaa vec_all_regions
- * @return vectorin jossa kaikkien alueiden id:t
+ * @brief Datastructures::train_stations_from
+ * hakee junan vuoron pysähdykset annetulta asemalta eteenpäin
+ * @param stationid asema, jolta vuoroa seurataan
+ * @param trainid juna, jonka vuoro halutaan
+ * @return vectori (asema, lähtöaika) -pareja lähtöajan mukaan järjestyksessä
+ * alkaen annetusta asemasta, jos asemaa tai junaa ei ole olemassa tai juna
+ * ei pysähdy asemalla {{NO_STATION, NO_TIME}}
  */
-std::vector<RegionID> Datastructures::all_regions()
+std::vector<std::pair<StationID, Time>> Datastructures::train_stations_from(StationID stationid, TrainID trainid)
 {
-    return vec_all_regions;
+    return train_stations_from(find_station(stationid), trainid);
 }
 
 /**
- * @brief Datastructures::get_region_name
- * hakee id:tä vastaavan alueen nimen
- * @param id alueen id, jonka nimi halutaan
- * @return id:tä vastaavan alueen nimi,
- * NO_NAME, jos aluetta ei ole olemassa
+ * @brief Datastructures::train_stations_from
+ * hakee junan vuoron pysähdykset kahvaa vastaavalta asemalta eteenpäin
+ * @param handle aseman kahva
+ * @param trainid juna, jonka vuoro halutaan
+ * @return vectori (asema, lähtöaika) -pareja lähtöajan mukaan järjestyksessä
+ * alkaen annetusta asemasta, jos asemaa tai junaa ei ole olemassa tai juna
+ * ei pysähdy asemalla {{NO_STATION, NO_TIME}}
  */
-Name Datastructures::get_region_name(RegionID id)
+std::vector<std::pair<StationID, Time>> Datastructures::train_stations_from(StationHandle handle, TrainID const& trainid)
 {
-    if(!regionExists(id)){
-        return NO_NAME;
+    auto train = train_stops.find(trainid);
+    if(!valid_station(handle) or train == train_stops.end()){
+        return {{NO_STATION, NO_TIME}};
     }
-    return regions.at(id)->regionName;
+    StationHandle station = handle_slot(handle);
+    pmr::vector<TrainStop> const& stops = train->second;
+    size_t count = stops.size();
+    size_t start = trip_start(stops);
+
+    // vuoro alkaa aseman ensimmäisestä pysähdyksestä ajojärjestyksessä
+    size_t first = 0;
+    while(first < count and stops[(start + first) % count].second != station){
+        ++first;
+    }
+    if(first == count){
+        return {{NO_STATION, NO_TIME}};
+    }
+
+    vector<pair<StationID, Time>> vec;
+    vec.reserve(count - first);
+    for(size_t i = first; i < count; ++i){
+        TrainStop const& stop = stops[(start + i) % count];
+        vec.push_back( { station_ids[stop.second], stop.first } );
+    }
+    return vec;
 }
 
 /**
- * @brief Datastructures::get_region_coords
- * hakee id:tä vastaavan alueen koordinaatit
- * @param id alueen id, jonka koordinaatit halutaan
- * @return vectorin, jossa alueen koordinaati
- * {NO_COORD}, jos aluetta ei ole olemassa
+ * @brief Datastructures::route_earliest_arrival
+ * etsii reitin, jolla pääsee lähtöasemalta annetun ajan jälkeen
+ * mahdollisimman aikaisin perille
+ * @param fromid lähtöasema
+ * @param toid määränpää
+ * @param starttime aikaisin mahdollinen lähtöaika
+ * @return vectori (asema, juna, lähtöaika) -kolmikoita reitin jokaiselta
+ * asemalta, viimeisenä (määränpää, NO_TRAIN, saapumisaika), tyhjä jos
+ * reittiä ei ole, jos asemaa ei ole olemassa {{NO_STATION, NO_TRAIN, NO_TIME}}
  */
-std::vector<Coord> Datastructures::get_region_coords(RegionID id)
+std::vector<std::tuple<StationID, TrainID, Time>> Datastructures::route_earliest_arrival(StationID fromid, StationID toid, Time starttime)
 {
-    if(!regionExists(id)){
-        return {NO_COORD};
-    }
-    return regions.at(id)->regionCoords;
+    return route_earliest_arrival(find_station(fromid), find_station(toid), starttime);
 }
 
 /**
- * @brief Datastructures::add_subregion_to_region
- * lisää alueella alialueen
- * @param id alialueen id
- * @param parentid parent alueen id
- * @return false, jos annetut alueet eivät ole olemassa,
- * true, jos lisäys onnistui
+ * @brief Datastructures::route_earliest_arrival
+ * yhteyshaku (connection scan): käy lähtöajan jälkeiset yhteydet kerran
+ * läpi aikajärjestyksessä ja pitää kirjaa aikaisimmasta saapumisajasta
+ * jokaiselle asemalle. Yhteyttä voi käyttää, jos sen junaan on jo noustu
+ * tai sen lähtöasemalle ehtii ennen lähtöä. Haku loppuu, kun määränpäähän
+ * on jo saavuttu ennen seuraavan yhteyden lähtöä.
+ * @param fromhandle lähtöaseman kahva
+ * @param tohandle määränpään kahva
+ * @param starttime aikaisin mahdollinen lähtöaika
+ * @return kuten route_earliest_arrival(StationID, ...)
  */
-bool Datastructures::add_subregion_to_region(RegionID id, RegionID parentid)
+std::vector<std::tuple<StationID, TrainID, Time>> Datastructures::route_earliest_arrival(StationHandle fromhandle, StationHandle tohandle, Time starttime)
 {
-    if(!(regionExists(id) and regionExists(parentid))){
-        return false;
-    } if(regions.at(id)->parentRegion == NO_REGION){
-
-        RegionID parent = parentid;
-        RegionID child = id;
-
-        regions.at(id)->parentRegion = parentid;
-        regions.at(parent)->subRegions.insert(id);
-
-
-
-        while(parent != NO_REGION){
-            regions.at(parent)->subRegions.insert(regions.at(child)->subRegions.begin(), regions.at(child)->subRegions.end());
-            child = parent;
-            parent = regions.at(parent)->parentRegion;
-        }
-
-
-        return true;
+    if(!valid_station(fromhandle) or !valid_station(tohandle) or minute_of_day(starttime) < 0){
+        return {{NO_STATION, NO_TRAIN, NO_TIME}};
     }
-    return false;
-
+    StationHandle from = handle_slot(fromhandle);
+    StationHandle to = handle_slot(tohandle);
+    if(from == to){
+        return {{station_ids[from], NO_TRAIN, starttime}};
+    }
+    update_connections();
+
+    // aikaisin saapumisaika, ja millä junan osuudella (nousu, poistuminen) asemalle tultiin
+    vector<Time> arrival(station_ids.size(), NO_TIME);
+    vector<pair<size_t, size_t>> reached_by(station_ids.size());
+    vector<size_t> boarded(trip_ids.size(), NO_INDEX);
+    arrival[from] = starttime;
+
+    auto first = lower_bound(connections.begin(), connections.end(), starttime,
+                             [](Connection const& c, Time time){ return c.departure < time; });
+    for(size_t i = first - connections.begin(); i < connections.size(); ++i){
+        Connection const& c = connections[i];
+        if(arrival[to] <= c.departure){
+            break;
+        }
+        // keskiyön yli menevää yhteyttä ei voi käyttää saman päivän reitillä
+        if(c.arrival < c.departure){
+            continue;
+        }
+        if(boarded[c.trip] == NO_INDEX){
+            if(arrival[c.from] > c.departure){
+                continue;
+            }
+            boarded[c.trip] = i;
+        }
+        if(c.arrival < arrival[c.to]){
+            arrival[c.to] = c.arrival;
+            reached_by[c.to] = { boarded[c.trip], i };
+        }
+    }
+
+    vector<tuple<StationID, TrainID, Time>> vec;
+    if(arrival[to] == NO_TIME){
+        return vec;
+    }
+    vec.push_back( { station_ids[to], NO_TRAIN, arrival[to] } );
+
+    // kuljetaan osuudet takaperin, kunkin osuuden pysähdykset junan vuorosta
+    for(StationHandle station = to; station != from; ){
+        Connection const& enter = connections[reached_by[station].first];
+        Connection const& exit = connections[reached_by[station].second];
+        TrainID const& trainid = trip_ids[enter.trip];
+        pmr::vector<TrainStop> const& stops = train_stops.at(trainid);
+
+        auto begin = lower_bound(stops.begin(), stops.end(), TrainStop{enter.departure, enter.from});
+        auto end = lower_bound(begin, stops.end(), TrainStop{exit.departure, exit.from});
+        for(auto it = end; it >= begin; --it){
+            vec.push_back( { station_ids[it->second], trainid, it->first } );
+            if(it == begin){
+                break;
+            }
+        }
+        station = enter.from;
+    }
+    reverse(vec.begin(), vec.end());
+    return vec;
+}
+
+/**
+ * @brief Datastructures::stations_reachable_within
+ * etsii asemat, joille pääsee junilla annetun ajan kuluessa lähtöhetkestä
+ * @param stationid lähtöasema
+ * @param starttime lähtöaika
+ * @param minutes aikaraja minuutteina
+ * @return saavutettavat asemat saapumisajan ja samaan aikaan saavutetut id:n mukaan
+ * järjestettynä, lähtöasema ensimmäisenä, {NO_STATION} jos asemaa ei ole tai aika ei kelpaa
+ */
+std::vector<StationID> Datastructures::stations_reachable_within(StationID stationid, Time starttime, int minutes)
+{
+    return stations_reachable_within(find_station(stationid), starttime, minutes);
+}
+
+/**
+ * @brief Datastructures::stations_reachable_within
+ * yksi scan_arrivals-haku aikarajaan asti. Aikaraja päättyy viimeistään
+ * keskiyöllä, koska yhteydet eivät jatku seuraavaan päivään.
+ * @param handle lähtöaseman kahva
+ * @param starttime lähtöaika
+ * @param minutes aikaraja minuutteina
+ * @return kuten stations_reachable_within(StationID, ...)
+ */
+std::vector<StationID> Datastructures::stations_reachable_within(StationHandle handle, Time starttime, int minutes)
+{
+    int start = minute_of_day(starttime);
+    if(!valid_station(handle) or start < 0 or minutes < 0){
+        return {NO_STATION};
+    }
+    StationHandle station = handle_slot(handle);
+    update_connections();
+
+    int last = min<int>(start + minutes, MINUTES_PER_DAY - 1);
+    vector<Time> arrival;
+    vector<bool> boarded;
+    scan_arrivals(station, starttime, (last / 60) * 100 + last % 60, arrival, boarded);
+
+    vector<StationHandle> reached;
+    for(StationHandle other = 0; other < arrival.size(); ++other){
+        if(arrival[other] != NO_TIME){
+            reached.push_back(other);
+        }
+    }
+    // lähtöasema ensin, vaikka jokin muu asema saavutettaisiin samalla minuutilla,
+    // muuten samaan aikaan saavutetut id:n mukaan
+    sort(reached.begin(), reached.end(), [this, &arrival, station](StationHandle a, StationHandle b){
+        return std::forward_as_tuple(arrival[a], a != station, station_ids[a]) < std::forward_as_tuple(arrival[b], b != station, station_ids[b]);
+    });
+    vector<StationID> vec;
+    vec.reserve(reached.size());
+    for(StationHandle other : reached){
+        vec.push_back(station_ids[other]);
+    }
+    return vec;
+}
+
+/**
+ * @brief Datastructures::travel_time_matrix
+ * laskee aikaisimmat saapumisajat jokaisesta annetusta asemasta jokaiseen
+ * annettuun asemaan. Yhteydet päivitetään ensin, minkä jälkeen säikeet
+ * lukevat niitä vain lukien ja ottavat seuraavan lähtöaseman yhteisestä
+ * atomisesta laskurista, joten pitkät ja lyhyet haut tasoittuvat säikeiden
+ * kesken.
+ * @param stationids asemat, sekä lähtö- että määränpäinä
+ * @param starttime lähtöaika
+ * @param threads säikeiden määrä, 0 = laitteiston säikeiden määrä
+ * @return rivi kerrallaan (lähtöasema) tallennettu s×s-matriisi saapumisaikoja,
+ * NO_TIME jos määränpäähän ei pääse, {NO_TIME} jos jotain asemaa ei ole
+ * olemassa tai aika ei kelpaa
+ */
+std::vector<Time> Datastructures::travel_time_matrix(std::vector<StationID> const& stationids, Time starttime, unsigned int threads)
+{
+    vector<StationHandle> handles;
+    handles.reserve(stationids.size());
+    for(StationID const& id : stationids){
+        StationHandle handle = find_station(id);
+        if(!valid_station(handle)){
+            return {NO_TIME};
+        }
+        handles.push_back(handle_slot(handle));
+    }
+    if(minute_of_day(starttime) < 0){
+        return {NO_TIME};
+    }
+    update_connections();
+
+    size_t count = handles.size();
+    vector<Time> matrix(count * count, NO_TIME);
+    if(threads == 0){
+        threads = max(1u, std::thread::hardware_concurrency());
+    }
+    threads = min<size_t>(threads, count);
+
+    std::atomic<size_t> next_row{0};
+    auto worker = [&](){
+        vector<Time> arrival;
+        vector<bool> boarded;
+        for(size_t row = next_row++; row < count; row = next_row++){
+            scan_arrivals(handles[row], starttime, 2359, arrival, boarded);
+            Time* out = matrix.data() + row * count;
+            for(size_t column = 0; column < count; ++column){
+                out[column] = arrival[handles[column]];
+            }
+        }
+    };
+    vector<std::thread> workers;
+    for(unsigned int i = 1; i < threads; ++i){
+        workers.emplace_back(worker);
+    }
+    worker();
+    for(std::thread& thread : workers){
+        thread.join();
+    }
+    return matrix;
+}
+
+/**
+ * @brief Datastructures::route_shortest_distance
+ * etsii junayhteyksiä pitkin matkaltaan lyhimmän reitin asemien välillä
+ * @param fromid lähtöasema
+ * @param toid määränpää
+ * @return vectori (asema, juna, kuljettu matka) -kolmikoita reitin jokaiselta
+ * asemalta, viimeisenä (määränpää, NO_TRAIN, koko matka), tyhjä jos reittiä
+ * ei ole, jos asemaa ei ole olemassa {{NO_STATION, NO_TRAIN, NO_DISTANCE}}
+ */
+std::vector<std::tuple<StationID, TrainID, Distance>> Datastructures::route_shortest_distance(StationID fromid, StationID toid)
+{
+    return route_shortest_distance(find_station(fromid), find_station(toid));
+}
+
+/**
+ * @brief Datastructures::route_shortest_distance_dijkstra
+ * kuten route_shortest_distance, mutta ilman A*-heuristiikkaa
+ * @param fromid lähtöasema
+ * @param toid määränpää
+ * @return kuten route_shortest_distance
+ */
+std::vector<std::tuple<StationID, TrainID, Distance>> Datastructures::route_shortest_distance_dijkstra(StationID fromid, StationID toid)
+{
+    return route_shortest_distance(find_station(fromid), find_station(toid), false);
+}
+
+/**
+ * @brief Datastructures::route_shortest_distance
+ * A*-haku: asemia käsitellään järjestyksessä kuljettu matka + linnuntie-etäisyys
+ * määränpäähän. Kaarten pituudet ovat asemien välisiä euklidisia etäisyyksiä,
+ * joten linnuntie ei koskaan yliarvioi jäljellä olevaa matkaa ja ensimmäinen
+ * kekoon noussut määränpää on lyhin reitti.
+ * @param fromhandle lähtöaseman kahva
+ * @param tohandle määränpään kahva
+ * @param use_heuristic false, jos haku tehdään tavallisena Dijkstrana
+ * @return kuten route_shortest_distance(StationID, ...)
+ */
+std::vector<std::tuple<StationID, TrainID, Distance>> Datastructures::route_shortest_distance(StationHandle fromhandle, StationHandle tohandle,
+                                                                                              bool use_heuristic)
+{
+    if(!valid_station(fromhandle) or !valid_station(tohandle)){
+        return {{NO_STATION, NO_TRAIN, NO_DISTANCE}};
+    }
+    StationHandle from = handle_slot(fromhandle);
+    StationHandle to = handle_slot(tohandle);
+    update_graph();
+    vector<tuple<StationID, TrainID, Distance>> vec;
+    if(from == to){
+        vec.push_back( { station_ids[to], NO_TRAIN, 0 } );
+        return vec;
+    }
+    // asemalle, jolle ei tule yhtään kaarta, ei ole reittiä
+    if(!graph_has_incoming[to]){
+        return vec;
+    }
+
+    double const unreached = std::numeric_limits<double>::infinity();
+    vector<double> distance(station_ids.size(), unreached);
+    // mistä asemasta ja millä junalla asemalle tultiin
+    vector<pair<StationHandle, std::uint32_t>> previous(station_ids.size(), { NO_STATION_HANDLE, NO_TRIP });
+    vector<bool> done(station_ids.size(), false);
+
+    using Entry = pair<double, StationHandle>;
+    priority_queue<Entry, vector<Entry>, greater<Entry>> queue;
+    distance[from] = 0;
+    queue.push( { use_heuristic ? calc_distance(from, to) : 0, from } );
+
+    while(!queue.empty()){
+        StationHandle station = queue.top().second;
+        queue.pop();
+        if(done[station]){
+            continue;
+        }
+        done[station] = true;
+        if(station == to){
+            break;
+        }
+
+        for(size_t i = graph_offsets[station]; i < graph_offsets[station + 1]; ++i){
+            GraphEdge const& edge = graph_edges[i];
+            double length = distance[station] + edge.length;
+            if(length < distance[edge.to]){
+                distance[edge.to] = length;
+                previous[edge.to] = { station, edge.trip };
+                queue.push( { length + (use_heuristic ? calc_distance(edge.to, to) : 0), edge.to } );
+            }
+        }
+    }
+
+    if(distance[to] == unreached){
+        return vec;
+    }
+    vec.push_back( { station_ids[to], NO_TRAIN, static_cast<Distance>(distance[to]) } );
+    for(StationHandle station = to; station != from; ){
+        auto [prev, trip] = previous[station];
+        vec.push_back( { station_ids[prev], trip_ids[trip], static_cast<Distance>(distance[prev]) } );
+        station = prev;
+    }
+    reverse(vec.begin(), vec.end());
+    return vec;
+}
+
+/**
+ * @brief Datastructures::build_route_hierarchy
+ * rakentaa reittihierarkian nykyisestä junaverkosta. Taustatilassa rakennus
+ * käynnistetään erillisessä säikeessä verkon kopiosta, ja se käynnistetään
+ * uudelleen aina, kun verkko on muuttunut. Muuten hierarkia rakennetaan vain
+ * tässä kutsussa. Kunnes hierarkia vastaa verkkoa,
+ * route_shortest_distance_hierarchy käyttää A*-hakua.
+ * @param background true, jos hierarkia rakennetaan taustalla
+ * @return true, jos hierarkia on valmis käytettäväksi
+ */
+bool Datastructures::build_route_hierarchy(bool background)
+{
+    hierarchy_background = background;
+    return update_hierarchy(true);
+}
+
+/**
+ * @brief Datastructures::route_shortest_distance_hierarchy
+ * kuten route_shortest_distance, mutta haku tehdään reittihierarkiassa
+ * @param fromid lähtöasema
+ * @param toid määränpää
+ * @return kuten route_shortest_distance
+ */
+std::vector<std::tuple<StationID, TrainID, Distance>> Datastructures::route_shortest_distance_hierarchy(StationID fromid, StationID toid)
+{
+    StationHandle from = find_station(fromid);
+    StationHandle to = find_station(toid);
+    if(!valid_station(from) or !valid_station(to)){
+        return {{NO_STATION, NO_TRAIN, NO_DISTANCE}};
+    }
+    // hierarkian jälkeen lisätyillä asemilla ei ole kaaria, A* päättyy heti
+    if(from == to or !update_hierarchy(false) or
+       max(handle_slot(from), handle_slot(to)) >= hierarchy.rank.size()){
+        return route_shortest_distance(from, to);
+    }
+    return hierarchy_route(handle_slot(from), handle_slot(to));
+}
+
+/**
+ * @brief Datastructures::add_region
+ * lisää alueen tietorakenteeseen
+ * regions ja vec_all_regions
+ * @param id alueen id
+ * @param name alueen nimi
+ * @param coords alueen rajojen koordinaatit
+ * @return false, jos alue on jo olemassa
+ * true, lisäys onnistuu, alue ei ollut vielä olemassa
+ */
+bool Datastructures::add_region(RegionID id, const Name &name, std::vector<Coord> const& coords)
+{
+    if(regionExists(id)){
+        return false;
+    }
+
+    shared_ptr<RegionInfo> newRegion = allocate_shared<RegionInfo>(pmr::polymorphic_allocator<RegionInfo>(&pool),
+                                                                   id, name, &pool);
+    regions.insert( { id, newRegion } );
+
+    newRegion->boundsLow = newRegion->boundsHigh = coords.empty() ? NO_COORD : coords.front();
+    for(Coord const& xy : coords){
+        newRegion->boundsLow = { min(newRegion->boundsLow.x, xy.x), min(newRegion->boundsLow.y, xy.y) };
+        newRegion->boundsHigh = { max(newRegion->boundsHigh.x, xy.x), max(newRegion->boundsHigh.y, xy.y) };
+    }
+    // kengännauhakaava (shoelace) ja painopiste samoista ristituloista,
+    // painopisteen summat liukulukuina koska ne ylittävät long long int:n
+    long double sum_x = 0;
+    long double sum_y = 0;
+    for(size_t i = 0, j = coords.size() - 1; i < coords.size(); j = i++){
+        long long int cross = static_cast<long long int>(coords[j].x) * coords[i].y -
+                static_cast<long long int>(coords[i].x) * coords[j].y;
+        newRegion->doubleArea += cross;
+        sum_x += static_cast<long double>(static_cast<long long int>(coords[j].x) + coords[i].x) * cross;
+        sum_y += static_cast<long double>(static_cast<long long int>(coords[j].y) + coords[i].y) * cross;
+    }
+    if(newRegion->doubleArea != 0){
+        newRegion->centroid = { static_cast<int>(llroundl(sum_x / (3.0L * newRegion->doubleArea))),
+                                static_cast<int>(llroundl(sum_y / (3.0L * newRegion->doubleArea))) };
+    } else {
+        // surkastunut monikulmio: suorakulmion keskipiste
+        newRegion->centroid = coords.empty() ? NO_COORD :
+                Coord{ static_cast<int>((static_cast<long long int>(newRegion->boundsLow.x) + newRegion->boundsHigh.x) / 2),
+                       static_cast<int>((static_cast<long long int>(newRegion->boundsLow.y) + newRegion->boundsHigh.y) / 2) };
+    }
+
+    // kärjet pakattuina yhteiseen tavutaulukkoon
+    newRegion->verticesBegin = polygon_bytes.size();
+    newRegion->vertexCount = coords.size();
+    Coord previous{0, 0};
+    for(Coord const& xy : coords){
+        append_varint(polygon_bytes, static_cast<long long int>(xy.x) - previous.x);
+        append_varint(polygon_bytes, static_cast<long long int>(xy.y) - previous.y);
+        previous = xy;
+    }
+
+    vec_all_regions.push_back(id);
+    region_order_dirty = true;
+    rtree_dirty = true;
+    ++epoch;
+
+    return true;
+
+}
+
+/**
+ * @brief Datastructures::all_regions
+ * palauttaa vec_all_regions
+ * @return vectorin jossa kaikkien alueiden id:t
+ */
+std::vector<RegionID> Datastructures::all_regions()
+{
+    return {vec_all_regions.begin(), vec_all_regions.end()};
+}
+
+/**
+ * @brief Datastructures::get_region_name
+ * hakee id:tä vastaavan alueen nimen
+ * @param id alueen id, jonka nimi halutaan
+ * @return id:tä vastaavan alueen nimi,
+ * NO_NAME, jos aluetta ei ole olemassa
+ */
+Name Datastructures::get_region_name(RegionID id)
+{
+    if(!regionExists(id)){
+        return NO_NAME;
+    }
+    return regions.at(id)->regionName;
+}
+
+/**
+ * @brief Datastructures::get_region_coords
+ * hakee id:tä vastaavan alueen koordinaatit
+ * @param id alueen id, jonka koordinaatit halutaan
+ * @return vectorin, jossa alueen koordinaati
+ * {NO_COORD}, jos aluetta ei ole olemassa
+ */
+std::vector<Coord> Datastructures::get_region_coords(RegionID id)
+{
+    if(!regionExists(id)){
+        return {NO_COORD};
+    }
+    std::vector<Coord> coords;
+    get_region_coords(id, coords);
+    return coords;
+}
+
+/**
+ * @brief Datastructures::add_subregion_to_region
+ * lisää alueella alialueen
+ * @param id alialueen id
+ * @param parentid parent alueen id
+ * @return false, jos annetut alueet eivät ole olemassa,
+ * true, jos lisäys onnistui
+ */
+bool Datastructures::add_subregion_to_region(RegionID id, RegionID parentid)
+{
+    if(!(regionExists(id) and regionExists(parentid))){
+        return false;
+    }
+    // alue ei voi olla oman alialueensa alialue
+    RegionInfo* region = regions.at(id).get();
+    RegionInfo* parentRegion = regions.at(parentid).get();
+    if(parentRegion->depth >= region->depth and lift_region(parentRegion, region->depth) == region){
+        return false;
+    }
+    if(region->parentRegion == NO_REGION){
+
+        region->parentRegion = parentid;
+        parentRegion->childRegions.push_back(region);
+        add_region_totals(parentid, region->stationCount, region->departureCount);
+        region_order_dirty = true;
+        ++epoch;
+
+        // siirtyvän alipuun syvyydet ja esivanhempitaulut ylhäältä alas
+        vector<pair<RegionInfo*, RegionInfo*>> stack{ { region, parentRegion } };
+        while(!stack.empty()){
+            auto [sub, subparent] = stack.back();
+            stack.pop_back();
+            update_ancestors(*sub, subparent);
+            for(RegionInfo* child : sub->childRegions){
+                stack.push_back( { child, sub } );
+            }
+        }
+
+        return true;
+    }
+    return false;
+
 }
 
 /**
@@ -383,10 +1371,25 @@ bool Datastructures::add_subregion_to_region(RegionID id, RegionID parentid)
  */
 bool Datastructures::add_station_to_region(StationID id, RegionID parentid)
 {
-    if(!(stationExists(id) and regionExists(parentid))){return false;}
-    else if(stations.at(id)->region != NO_REGION){return false;}
+    return add_station_to_region(find_station(id), parentid);
+}
+
+/**
+ * @brief Datastructures::add_station_to_region
+ * lisää kahvaa vastaavan aseman alueeseen
+ * @param handle aseman kahva
+ * @param parentid alueen id
+ * @return true, jos lisäys onnistui,
+ * false, jos asemaa tai aluetta ei ole olemassa tai asemalla on jo alue
+ */
+bool Datastructures::add_station_to_region(StationHandle handle, RegionID parentid)
+{
+    if(!(valid_station(handle) and regionExists(parentid))){return false;}
+    StationHandle station = handle_slot(handle);
+    if(station_regions[station] != NO_REGION){return false;}
 
-    stations.at(id)->region = parentid;
+    // käsin liitetty asema ei enää seuraa rajoja
+    attach_station_to_region(station, parentid, false);
     return true;
 }
 
@@ -399,8 +1402,21 @@ bool Datastructures::add_station_to_region(StationID id, RegionID parentid)
  */
 std::vector<RegionID> Datastructures::station_in_regions(StationID id)
 {
-    if(!stationExists(id)){return {NO_REGION};}
-    RegionID regid = stations.at(id)->region;
+    return station_in_regions(find_station(id));
+}
+
+/**
+ * @brief Datastructures::station_in_regions
+ * hakee kaikki alueet joihin kahvaa vastaava asema kuuluu suoraan ja epäsuorasti
+ * @param handle aseman kahva
+ * @return vectorin, jossa alueiden id:t
+ * {NO_REGION}, jos asemaa ei ole olemassa
+ */
+std::vector<RegionID> Datastructures::station_in_regions(StationHandle handle)
+{
+    if(!valid_station(handle)){return {NO_REGION};}
+    StationHandle station = handle_slot(handle);
+    RegionID regid = station_regions[station];
     vector<RegionID> vec;
     while(regid != NO_REGION){
         vec.push_back(regid);
@@ -409,6 +1425,64 @@ std::vector<RegionID> Datastructures::station_in_regions(StationID id)
     return vec;
 }
 
+/**
+ * @brief Datastructures::stations_in_region
+ * hakee kaikki asemat, jotka kuuluvat alueeseen suoraan tai sen alialueiden
+ * kautta. Alue ja sen alialueet ovat peräkkäin region_order:ssa, ja
+ * jokaisella alueella on lista siihen suoraan lisätyistä asemista.
+ * @param id alueen id
+ * @return vectorin, jossa asemien id:t,
+ * {NO_STATION}, jos aluetta ei ole olemassa
+ */
+std::vector<StationID> Datastructures::stations_in_region(RegionID id)
+{
+    auto it = regions.find(id);
+    if(it == regions.end()){
+        return {NO_STATION};
+    }
+    update_region_order();
+    vector<StationID> vec;
+    for(size_t i = it->second->subtreeBegin; i < it->second->subtreeEnd; ++i){
+        for(StationHandle station : regions.at(region_order[i])->regionStations){
+            vec.push_back(station_ids[station]);
+        }
+    }
+    return vec;
+}
+
+/**
+ * @brief Datastructures::region_stats
+ * hakee alueen ja sen alialueiden asemien ja lähtöjen määrät
+ * @param id alueen id
+ * @return (asemien määrä, lähtöjen määrä),
+ * {NO_VALUE, NO_VALUE}, jos aluetta ei ole olemassa
+ */
+std::pair<int, int> Datastructures::region_stats(RegionID id)
+{
+    auto it = regions.find(id);
+    if(it == regions.end()){
+        return {NO_VALUE, NO_VALUE};
+    }
+    return {it->second->stationCount, it->second->departureCount};
+}
+
+/**
+ * @brief Datastructures::region_geometry
+ * hakee alueen rajoista add_region:ssa lasketut tiedot
+ * @param id alueen id
+ * @return (suorakulmion alakulma, yläkulma, etumerkillinen pinta-ala, painopiste),
+ * {NO_COORD, NO_COORD, NO_VALUE, NO_COORD}, jos aluetta ei ole olemassa
+ */
+std::tuple<Coord, Coord, double, Coord> Datastructures::region_geometry(RegionID id)
+{
+    auto it = regions.find(id);
+    if(it == regions.end()){
+        return {NO_COORD, NO_COORD, NO_VALUE, NO_COORD};
+    }
+    RegionInfo const& region = *it->second;
+    return {region.boundsLow, region.boundsHigh, region.doubleArea / 2.0, region.centroid};
+}
+
 //---------------------------------------------------------------------------------------------
 
 /**
@@ -423,10 +1497,30 @@ std::vector<RegionID> Datastructures::all_subregions_of_region(RegionID id)
     if(!regionExists(id)){
         return {NO_REGION};
     }
-    vector<RegionID> sub_regs;
-    sub_regs.insert(sub_regs.begin(), regions.at(id)->subRegions.begin(), regions.at(id)->subRegions.end());
-    return sub_regs;
+    update_region_order();
+    RegionInfo const& region = *regions.at(id);
+    return {region_order.begin() + region.subtreeBegin + 1, region_order.begin() + region.subtreeEnd};
+
+}
 
+/**
+ * @brief Datastructures::is_subregion_of
+ * tarkistaa, onko alue toisen alueen suora tai epäsuora alialue
+ * @param id alialueeksi epäilty alue
+ * @param parentid alue, jonka alipuusta etsitään
+ * @return true, jos id on parentid:n alialue,
+ * false, jos ei ole tai jompaakumpaa aluetta ei ole olemassa
+ */
+bool Datastructures::is_subregion_of(RegionID id, RegionID parentid)
+{
+    auto it = regions.find(id);
+    auto parent = regions.find(parentid);
+    if(it == regions.end() or parent == regions.end()){
+        return false;
+    }
+    update_region_order();
+    return parent->second->subtreeBegin < it->second->subtreeBegin and
+            it->second->subtreeBegin < parent->second->subtreeEnd;
 }
 
 /**
@@ -438,21 +1532,32 @@ std::vector<RegionID> Datastructures::all_subregions_of_region(RegionID id)
  */
 std::vector<StationID> Datastructures::stations_closest_to(Coord xy)
 {
-    map<int, StationID> dist_of_stations;
-    vector<StationID> stations_closest;
-    int dist;
-    for(auto it = vec_all_stations.begin(); it != vec_all_stations.end(); ++it){
-        dist = calc_distance(xy, *it);
-        dist_of_stations.insert({dist, *it});
-
-        if(dist_of_stations.size() == 4){
-            dist_of_stations.erase(--dist_of_stations.end());
-        }
+    return stations_closest_to(xy, 3);
+}
 
+/**
+ * @brief Datastructures::stations_closest_to
+ * etsii koordinaattia enintään k lähintä asemaa k-d -puusta,
+ * etäisyydeltään samat asemat järjestetään id:n mukaan
+ * @param xy koordinaatti, jonka lähimmät asemat halutaan
+ * @param k haluttujen asemien määrä
+ * @return vector, jossa koordinaattia k lähintä asemaa lähin ensin
+ */
+std::vector<StationID> Datastructures::stations_closest_to(Coord xy, unsigned int k)
+{
+    vector<pair<long long int, StationHandle>> best;
+    if(k == 0){
+        return {};
     }
+    best.reserve(k + 1);
+    kd_search(kd_root, 0, xy, k, best);
 
-    for(auto jt = dist_of_stations.begin(); jt != dist_of_stations.end(); ++jt){
-        stations_closest.push_back(jt->second);
+    auto closer = [this](auto const& a, auto const& b){ return kd_closer(a, b); };
+    sort_heap(best.begin(), best.end(), closer);
+    vector<StationID> stations_closest;
+    stations_closest.reserve(best.size());
+    for(auto it = best.begin(); it != best.end(); ++it){
+        stations_closest.push_back(station_ids[it->second]);
     }
 
     return stations_closest;
@@ -466,15 +1571,64 @@ std::vector<StationID> Datastructures::stations_closest_to(Coord xy)
  * false, jos annettu asemaa ei ole olemassa
  */
 bool Datastructures::remove_station(StationID id)
+{
+    return remove_station(find_station(id));
+}
+
+/**
+ * @brief Datastructures::remove_station
+ * poistaa kahvaa vastaavan aseman, paikka vapautuu uudelleenkäyttöön
+ * ja sen sukupolvi kasvaa, joten vanhat kahvat lakkaavat olemasta voimassa
+ * @param handle poistettavan aseman kahva
+ * @return true, jos asema on olemassa
+ * false, jos annettu asemaa ei ole olemassa
+ */
+bool Datastructures::remove_station(StationHandle handle)
 {
 
-    if(stationExists(id)){
+    if(valid_station(handle)){
+        StationHandle station = handle_slot(handle);
 
-        auto it = remove(vec_all_stations.begin(), vec_all_stations.end(), id);
-        vec_all_stations.erase(it);
+        StationID const& id = station_ids[station];
 
+        // siirretään viimeinen asema poistettavan paikalle
+        size_t index = station_index[station];
+        StationID const& last = vec_all_stations.back();
+        station_index[stations.at(last)] = index;
+        vec_all_stations[index] = last;
+        vec_all_stations.pop_back();
+        ++epoch;
+
+        stations_by_name.erase( { station_names[station], id } );
+        stations_by_distance.erase(distance_key(station_coords[station], id));
+        erase_coord_index(station_coords[station], station);
+        kd_remove(station);
         stations.erase(id);
 
+        detach_station_from_region(station);
+
+        merge_departures(station);
+        for(Departure const& departure : station_departures[station]){
+            erase_from_bucket(station, departure);
+            erase_train_stop(departure.second, { departure.first, station });
+        }
+
+        // vapautetaan kahva ja sarakkeiden varaama muisti
+        station_index[station] = NO_INDEX;
+        station_coords[station] = NO_COORD;
+        station_names[station] = Name();
+        station_departures[station].clear();
+        station_pending_departures[station].clear();
+        station_ids[station] = StationID();
+        // paikka jää pois käytöstä, kun sen sukupolvet loppuvat
+        if(++station_generations[station] != RETIRED_GENERATION){
+            free_handles.push_back(station);
+        }
+
+        if(kd_removed * 2 >= kd_nodes.size()){
+            kd_rebuild();
+        }
+
         return true;
     }
     return false;
@@ -486,7 +1640,10 @@ bool Datastructures::remove_station(StationID id)
 
 /**
  * @brief Datastructures::common_parent_of_regions
- * etsii annettujen alueiden yhteisen vanhemman
+ * etsii annettujen alueiden lähimmän yhteisen vanhemman. Alueet nostetaan
+ * ensin samalle syvyydelle ja sitten yhtä aikaa suurimmin askelin, joilla
+ * ne eivät vielä kohtaa. Jos toinen alue on toisen yläpuolella, yhteinen
+ * vanhempi on sen oma vanhempi, koska alue ei ole itsensä alialue.
  * @param id1 alueen 1 id
  * @param id2 alueen 2 id
  * @return ensimmäisen hieratkiassa yhteisen vanhemman
@@ -499,45 +1656,1314 @@ RegionID Datastructures::common_parent_of_regions(RegionID id1, RegionID id2){
         return NO_REGION;
     }
 
-    RegionID regid1 = id1;
-    vector<RegionID> vec_id1;
-    while(regid1 != NO_REGION){
-        regid1 = regions.at(regid1)->parentRegion;
-        vec_id1.push_back(regid1);
-    }
-
-    RegionID regid2 = id2;
-    vector<RegionID> vec_id2;
-    while(regid2 != NO_REGION){
-        regid2 = regions.at(regid2)->parentRegion;
-        vec_id2.push_back(regid2);
-    }
-    for(auto it = vec_id1.begin(); it != vec_id2.end(); ++it){
-        if(find(vec_id2.begin(), vec_id2.end(), *it) != vec_id2.end()){
-            return *it;
+    RegionInfo* a = regions.at(id1).get();
+    RegionInfo* b = regions.at(id2).get();
+    unsigned int depth = min(a->depth, b->depth);
+    a = lift_region(a, depth);
+    b = lift_region(b, depth);
+    // jos a == b, toinen alueista on toisen esivanhempi (tai alueet ovat samat)
+    if(a != b){
+        for(size_t k = a->ancestors.size(); k-- > 0; ){
+            if(k < a->ancestors.size() and a->ancestors[k] != b->ancestors[k]){
+                a = a->ancestors[k];
+                b = b->ancestors[k];
+            }
         }
     }
-
-    return NO_REGION;
+    return a->ancestors.empty() ? NO_REGION : a->ancestors[0]->regionId;
 
 }
 
+/**
+ * @brief Datastructures::common_parents_of_regions
+ * vastaa moneen common_parent_of_regions -kyselyyn kerralla Tarjanin
+ * offline-algoritmilla: alueiden metsä käydään syvyyshaulla läpi, ja kun
+ * alue on käsitelty, se yhdistetään vanhempansa joukkoon. Parin toisen alueen
+ * valmistuessa toisen alueen joukon edustaja on parin yhteinen esivanhempi.
+ * @param pairs aluepareja
+ * @return jokaiselle parille sama tulos kuin common_parent_of_regions
+ */
+std::vector<RegionID> Datastructures::common_parents_of_regions(std::vector<std::pair<RegionID, RegionID>> const& pairs)
+{
+    vector<RegionID> result(pairs.size(), NO_REGION);
+
+    // alueille tiiviit indeksit ja lapsilistat
+    size_t count = vec_all_regions.size();
+    unordered_map<RegionID, size_t> index;
+    index.reserve(count);
+    for(size_t i = 0; i < count; ++i){
+        index.insert( { vec_all_regions[i], i } );
+    }
+    vector<size_t> parent(count, NO_INDEX);
+    vector<size_t> child_offsets(count + 1, 0);
+    for(size_t i = 0; i < count; ++i){
+        RegionID parentid = regions.at(vec_all_regions[i])->parentRegion;
+        if(parentid != NO_REGION){
+            parent[i] = index.at(parentid);
+            ++child_offsets[parent[i] + 1];
+        }
+    }
+    for(size_t i = 0; i < count; ++i){
+        child_offsets[i + 1] += child_offsets[i];
+    }
+    vector<size_t> children(child_offsets.back());
+    vector<size_t> fill(child_offsets.begin(), child_offsets.end() - 1);
+    for(size_t i = 0; i < count; ++i){
+        if(parent[i] != NO_INDEX){
+            children[fill[parent[i]]++] = i;
+        }
+    }
 
-
-
-
+    // kyselyt molempien alueiden kohdalle
+    vector<size_t> query_offsets(count + 1, 0);
+    vector<pair<size_t, size_t>> valid(pairs.size(), { NO_INDEX, NO_INDEX });
+    for(size_t q = 0; q < pairs.size(); ++q){
+        auto first = index.find(pairs[q].first);
+        auto second = index.find(pairs[q].second);
+        if(first != index.end() and second != index.end()){
+            valid[q] = { first->second, second->second };
+            ++query_offsets[first->second + 1];
+            ++query_offsets[second->second + 1];
+        }
+    }
+    for(size_t i = 0; i < count; ++i){
+        query_offsets[i + 1] += query_offsets[i];
+    }
+    vector<size_t> queries(query_offsets.back());
+    fill.assign(query_offsets.begin(), query_offsets.end() - 1);
+    for(size_t q = 0; q < pairs.size(); ++q){
+        if(valid[q].first != NO_INDEX){
+            queries[fill[valid[q].first]++] = q;
+            queries[fill[valid[q].second]++] = q;
+        }
+    }
+
+    // union-find polunpuolituksella, joukon edustajan esivanhempi ancestor-taulussa
+    vector<size_t> set_parent(count);
+    vector<size_t> ancestor(count);
+    vector<bool> done(count, false);
+    vector<size_t> tree(count);
+    auto find_set = [&set_parent](size_t x){
+        while(set_parent[x] != x){
+            set_parent[x] = set_parent[set_parent[x]];
+            x = set_parent[x];
+        }
+        return x;
+    };
+
+    // iteratiivinen syvyyshaku jokaisesta juuresta, pinossa (alue, seuraava lapsi)
+    vector<pair<size_t, size_t>> stack;
+    for(size_t root = 0; root < count; ++root){
+        if(parent[root] != NO_INDEX){
+            continue;
+        }
+        stack.push_back( { root, child_offsets[root] } );
+        set_parent[root] = root;
+        ancestor[root] = root;
+        tree[root] = root;
+        while(!stack.empty()){
+            auto& [node, next] = stack.back();
+            if(next < child_offsets[node + 1]){
+                size_t child = children[next++];
+                set_parent[child] = child;
+                ancestor[child] = child;
+                tree[child] = root;
+                stack.push_back( { child, child_offsets[child] } );
+                continue;
+            }
+            size_t finished = node;
+            stack.pop_back();
+            done[finished] = true;
+            for(size_t i = query_offsets[finished]; i < query_offsets[finished + 1]; ++i){
+                size_t q = queries[i];
+                size_t other = valid[q].first == finished ? valid[q].second : valid[q].first;
+                // eri puissa olevilla alueilla ei ole yhteistä vanhempaa
+                if(!done[other] or tree[other] != root){
+                    continue;
+                }
+                size_t common = ancestor[find_set(other)];
+                // yhteinen esivanhempi voi olla toinen alueista itse, jolloin
+                // vastaus on sen vanhempi
+                if(common == valid[q].first or common == valid[q].second){
+                    common = parent[common];
+                }
+                result[q] = common == NO_INDEX ? NO_REGION : vec_all_regions[common];
+            }
+            if(!stack.empty()){
+                size_t up = stack.back().first;
+                set_parent[find_set(finished)] = find_set(up);
+                ancestor[find_set(up)] = up;
+            }
+        }
+    }
+    return result;
+}
 
 /**
- * @brief Datastructures::stationExists
- * tarkistaa onko annettu asema olemassa
- * @param id asema, jona olemassa olo halutaan tietää
- * @return true, jos asema on olemassa
- * false, jos ei
+ * @brief Datastructures::valid_station
+ * tarkistaa, että kahva vastaa olemassa olevaa asemaa
+ * @param handle aseman kahva
+ * @return true, jos kahvan paikka on käytössä ja sukupolvi on paikan nykyinen
+ * false, jos paikka on vapaa, sen asema on vaihtunut tai kahva on NO_STATION_HANDLE
+ */
+bool Datastructures::valid_station(StationHandle handle){
+    StationHandle station = handle_slot(handle);
+    return station < station_index.size() and station_index[station] != NO_INDEX and
+            (handle >> HANDLE_INDEX_BITS) == station_generations[station];
+}
+
+/**
+ * @brief Datastructures::make_handle
+ * muodostaa käytössä olevasta paikasta ulos annettavan kahvan
+ * @param station aseman paikka
+ * @return kahva, jossa paikka ja sen nykyinen sukupolvi
+ */
+StationHandle Datastructures::make_handle(StationHandle station){
+    return station | static_cast<StationHandle>(station_generations[station]) << HANDLE_INDEX_BITS;
+}
+
+/**
+ * @brief Datastructures::handle_slot
+ * erottaa kahvasta aseman paikan, kahvan pitää olla tarkistettu valid_station:lla
+ * @param handle aseman kahva
+ * @return aseman paikka sarakkeissa
+ */
+StationHandle Datastructures::handle_slot(StationHandle handle){
+    return handle & HANDLE_INDEX_MASK;
+}
+
+/**
+ * @brief Datastructures::minute_of_day
+ * muuttaa HHMM-ajan minuuteiksi keskiyöstä, eli minuuttikorin indeksiksi
+ * @param time aika HHMM-muodossa
+ * @return minuutit keskiyöstä, -1 jos aika ei ole kelvollinen
+ */
+int Datastructures::minute_of_day(Time time){
+    int hours = time / 100;
+    int minutes = time % 100;
+    if(hours >= 24 or minutes >= 60){
+        return -1;
+    }
+    return hours * 60 + minutes;
+}
+
+/**
+ * @brief Datastructures::erase_from_bucket
+ * poistaa lähdön minuuttikorista vaihtamalla sen korin viimeiseen
+ * @param station aseman kahva
+ * @param departure poistettava lähtö
+ */
+void Datastructures::erase_from_bucket(StationHandle station, Departure const& departure){
+    pmr::vector<pair<StationHandle, TrainID>>& bucket = departure_buckets[minute_of_day(departure.first)];
+    for(auto it = bucket.begin(); it != bucket.end(); ++it){
+        if(it->first == station and it->second == departure.second){
+            *it = std::move(bucket.back());
+            bucket.pop_back();
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::add_train_stop
+ * lisää pysähdyksen junan vuoroon aikajärjestystä säilyttäen
+ * @param trainid junan id
+ * @param stop pysähdys (aika, asema)
+ */
+void Datastructures::add_train_stop(TrainID const& trainid, TrainStop stop){
+    pmr::vector<TrainStop>& stops = train_stops[trainid];
+    stops.insert(upper_bound(stops.begin(), stops.end(), stop), stop);
+    dirty_trains.insert(trainid);
+    graph_dirty = true;
+}
+
+/**
+ * @brief Datastructures::erase_train_stop
+ * poistaa pysähdyksen junan vuorosta, tyhjä vuoro poistetaan kokonaan
+ * @param trainid junan id
+ * @param stop pysähdys (aika, asema)
+ */
+void Datastructures::erase_train_stop(TrainID const& trainid, TrainStop stop){
+    auto train = train_stops.find(trainid);
+    if(train == train_stops.end()){
+        return;
+    }
+    pmr::vector<TrainStop>& stops = train->second;
+    auto it = lower_bound(stops.begin(), stops.end(), stop);
+    if(it != stops.end() and *it == stop){
+        stops.erase(it);
+        dirty_trains.insert(trainid);
+        graph_dirty = true;
+    }
+    if(stops.empty()){
+        train_stops.erase(train);
+    }
+}
+
+/**
+ * @brief Datastructures::trip_start
+ * etsii junan ensimmäisen pysähdyksen ajojärjestyksessä. Pysähdykset ovat
+ * kellonajan mukaan järjestyksessä, joten keskiyön yli kulkevan junan
+ * vuoro alkaa vasta vektorin keskeltä: vuoro alkaa suurimman aikavälin
+ * jälkeen, kun myös viimeisestä pysähdyksestä seuraavan päivän
+ * ensimmäiseen on yksi väli.
+ * @param stops junan pysähdykset aikajärjestyksessä
+ * @return ensimmäisen pysähdyksen indeksi, 0 jos juna ei ylitä keskiyötä
+ */
+size_t Datastructures::trip_start(pmr::vector<TrainStop> const& stops){
+    if(stops.empty()){
+        return 0;
+    }
+    size_t start = 0;
+    int largest_gap = minute_of_day(stops.front().first) + MINUTES_PER_DAY - minute_of_day(stops.back().first);
+    for(size_t i = 1; i < stops.size(); ++i){
+        int gap = minute_of_day(stops[i].first) - minute_of_day(stops[i - 1].first);
+        if(gap > largest_gap){
+            largest_gap = gap;
+            start = i;
+        }
+    }
+    return start;
+}
+
+/**
+ * @brief Datastructures::update_connections
+ * päivittää reittihaun yhteydet muuttuneiden junien osalta: niiden vanhat
+ * yhteydet poistetaan, uudet muodostetaan pysähdyksistä, järjestetään ja
+ * lomitetaan muiden yhteyksien joukkoon. Poistuneen junan numero vapautuu.
+ */
+void Datastructures::update_connections(){
+    if(dirty_trains.empty()){
+        return;
+    }
+
+    vector<bool> changed(trip_ids.size(), false);
+    vector<Connection> added;
+    for(TrainID const& trainid : dirty_trains){
+        auto number = trip_numbers.find(trainid);
+        std::uint32_t trip = NO_TRIP;
+        if(number != trip_numbers.end()){
+            trip = number->second;
+            changed[trip] = true;
+        }
+
+        auto train = train_stops.find(trainid);
+        if(train == train_stops.end()){
+            if(trip != NO_TRIP){
+                trip_ids[trip] = TrainID();
+                free_trips.push_back(trip);
+                trip_numbers.erase(number);
+            }
+            continue;
+        }
+
+        if(trip == NO_TRIP){
+            if(free_trips.empty()){
+                trip = trip_ids.size();
+                trip_ids.push_back(trainid);
+            }
+            else{
+                trip = free_trips.back();
+                free_trips.pop_back();
+                trip_ids[trip] = trainid;
+            }
+            trip_numbers[trainid] = trip;
+        }
+
+        pmr::vector<TrainStop> const& stops = train->second;
+        size_t count = stops.size();
+        size_t start = trip_start(stops);
+        for(size_t i = 0; i + 1 < count; ++i){
+            TrainStop const& stop = stops[(start + i) % count];
+            TrainStop const& next_stop = stops[(start + i + 1) % count];
+            added.push_back( { stop.first, next_stop.first, stop.second, next_stop.second, trip } );
+        }
+    }
+    dirty_trains.clear();
+
+    connections.erase(remove_if(connections.begin(), connections.end(),
+                                [&changed](Connection const& c){ return c.trip < changed.size() and changed[c.trip]; }),
+                      connections.end());
+
+    // vakaa järjestys säilyttää junan samalla minuutilla olevien
+    // yhteyksien keskinäisen järjestyksen
+    auto earlier = [](Connection const& a, Connection const& b){
+        return tie(a.departure, a.arrival, a.trip) < tie(b.departure, b.arrival, b.trip);
+    };
+    stable_sort(added.begin(), added.end(), earlier);
+    size_t middle = connections.size();
+    connections.insert(connections.end(), added.begin(), added.end());
+    inplace_merge(connections.begin(), connections.begin() + middle, connections.end(), earlier);
+}
+
+/**
+ * @brief Datastructures::scan_arrivals
+ * yhteyshaku ilman määränpäätä: yhteydet käydään lähtöajasta aikarajaan asti
+ * kerran läpi ja jokaiselle asemalle saadaan aikaisin saapumisaika. Ei muuta
+ * tietorakennetta, joten useampi säie voi hakea yhtä aikaa, kunhan yhteydet
+ * on päivitetty ennen hakuja.
+ * @param from lähtöaseman kahva
+ * @param starttime lähtöaika
+ * @param deadline viimeinen kelpaava saapumisaika
+ * @param arrival täytetään saapumisajoilla, NO_TIME jos asemalle ei päästy
+ * @param boarded apuvektori junien vuoroille, annetaan kutsujalta jotta
+ * muistia ei varata joka haulle erikseen
+ */
+void Datastructures::scan_arrivals(StationHandle from, Time starttime, Time deadline,
+                                   std::vector<Time>& arrival, std::vector<bool>& boarded) const
+{
+    arrival.assign(station_ids.size(), NO_TIME);
+    boarded.assign(trip_ids.size(), false);
+    arrival[from] = starttime;
+
+    auto first = lower_bound(connections.begin(), connections.end(), starttime,
+                             [](Connection const& c, Time time){ return c.departure < time; });
+    for(auto it = first; it != connections.end() and it->departure <= deadline; ++it){
+        Connection const& c = *it;
+        // keskiyön yli menevää yhteyttä ei voi käyttää saman päivän reitillä
+        if(c.arrival < c.departure or c.arrival > deadline){
+            continue;
+        }
+        if(!boarded[c.trip]){
+            if(arrival[c.from] > c.departure){
+                continue;
+            }
+            boarded[c.trip] = true;
+        }
+        if(c.arrival < arrival[c.to]){
+            arrival[c.to] = c.arrival;
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::update_graph
+ * rakentaa etäisyysreitityksen CSR-verkon yhteyksistä: kaaret lasketaan
+ * asemittain, järjestetään kohteen mukaan ja rinnakkaiset kaaret yhdistetään
+ */
+void Datastructures::update_graph(){
+    update_connections();
+    if(!graph_dirty){
+        // uusilla asemilla ei ole vielä kaaria, joten niille riittää tyhjä
+        // naapurilista eikä verkon versio (eikä hierarkia) vanhene
+        if(graph_offsets.size() < station_ids.size() + 1){
+            graph_offsets.resize(station_ids.size() + 1, graph_offsets.empty() ? 0 : graph_offsets.back());
+            graph_has_incoming.resize(station_ids.size(), false);
+        }
+        return;
+    }
+
+    vector<size_t> offsets(station_ids.size() + 1, 0);
+    for(Connection const& c : connections){
+        ++offsets[c.from + 1];
+    }
+    for(size_t i = 1; i < offsets.size(); ++i){
+        offsets[i] += offsets[i - 1];
+    }
+    vector<GraphEdge> edges(connections.size());
+    vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for(Connection const& c : connections){
+        edges[next[c.from]++] = { c.to, c.trip, 0 };
+    }
+
+    graph_offsets.assign(station_ids.size() + 1, 0);
+    graph_edges.clear();
+    graph_has_incoming.assign(station_ids.size(), false);
+    for(StationHandle station = 0; station < station_ids.size(); ++station){
+        auto begin = edges.begin() + offsets[station];
+        auto end = edges.begin() + offsets[station + 1];
+        sort(begin, end, [](GraphEdge const& a, GraphEdge const& b){
+            return tie(a.to, a.trip) < tie(b.to, b.trip);
+        });
+        for(auto it = begin; it != end; ++it){
+            if(it != begin and prev(it)->to == it->to){
+                continue;
+            }
+            graph_edges.push_back( { it->to, it->trip, calc_distance(station, it->to) } );
+            graph_has_incoming[it->to] = true;
+        }
+        graph_offsets[station + 1] = graph_edges.size();
+    }
+    graph_dirty = false;
+    ++graph_version;
+}
+
+/**
+ * @brief Datastructures::calc_distance
+ * laskee kahden aseman välisen euklidisen etäisyyden
+ * @param a aseman kahva
+ * @param b aseman kahva
+ * @return etäisyys liukulukuna
  */
-bool Datastructures::stationExists(StationID id){
-    return stations.find(id) != stations.end();
+double Datastructures::calc_distance(StationHandle a, StationHandle b){
+    Coord xy1 = station_coords[a];
+    Coord xy2 = station_coords[b];
+    double dx = double(xy1.x) - xy2.x;
+    double dy = double(xy1.y) - xy2.y;
+    return sqrt(dx * dx + dy * dy);
 }
 
+/**
+ * @brief Datastructures::graph_snapshot
+ * kopioi etäisyysverkon hierarkian rakentamista varten
+ * @return verkon kopio ja sen versio
+ */
+Datastructures::GraphSnapshot Datastructures::graph_snapshot(){
+    return { graph_version,
+             vector<size_t>(graph_offsets.begin(), graph_offsets.end()),
+             vector<GraphEdge>(graph_edges.begin(), graph_edges.end()) };
+}
+
+/**
+ * @brief Datastructures::build_hierarchy
+ * supistaa verkon asemat järjestyksessä, jossa ensin tulevat asemat, joiden
+ * supistaminen lisää vähiten oikopolkuja suhteessa poistuviin kaariin.
+ * Asemaa v supistettaessa jokaiselle polulle u -> v -> w lisätään oikopolku
+ * u -> w, ellei todistajahaku löydä v:n ohittavaa yhtä lyhyttä polkua.
+ * Todistajahaku on rajattu, joten oikopolkuja voi tulla tarpeettomasti,
+ * mutta ei koskaan liian vähän. Ei käytä luokan jäseniä, joten voidaan
+ * ajaa taustasäikeessä.
+ * @param graph verkon kopio
+ * @return valmis hierarkia
+ */
+Datastructures::RouteHierarchy Datastructures::build_hierarchy(GraphSnapshot const& graph){
+    size_t const WITNESS_LIMIT = 64;
+    double const unreached = std::numeric_limits<double>::infinity();
+
+    RouteHierarchy h;
+    h.version = graph.version;
+    size_t n = graph.offsets.size() - 1;
+
+    vector<vector<std::uint32_t>> out(n);
+    vector<vector<std::uint32_t>> in(n);
+    for(StationHandle station = 0; station < n; ++station){
+        for(size_t i = graph.offsets[station]; i < graph.offsets[station + 1]; ++i){
+            GraphEdge const& edge = graph.edges[i];
+            if(edge.to == station){
+                continue;
+            }
+            out[station].push_back(h.edges.size());
+            in[edge.to].push_back(h.edges.size());
+            h.edges.push_back( { station, edge.to, edge.length, edge.trip, NO_EDGE, NO_EDGE } );
+        }
+    }
+
+    vector<bool> contracted(n, false);
+    vector<int> contracted_neighbors(n, 0);
+    vector<int> level(n, 0);
+    vector<double> witness(n, unreached);
+    vector<StationHandle> reached;
+
+    using Entry = pair<double, StationHandle>;
+    // lyhimmät etäisyydet lähteestä, kun skip ja supistetut asemat ohitetaan
+    auto witness_search = [&](StationHandle source, StationHandle skip, double limit){
+        for(StationHandle station : reached){
+            witness[station] = unreached;
+        }
+        reached.clear();
+        witness[source] = 0;
+        reached.push_back(source);
+
+        priority_queue<Entry, vector<Entry>, greater<Entry>> queue;
+        queue.push( { 0, source } );
+        size_t settled = 0;
+        while(!queue.empty() and settled < WITNESS_LIMIT){
+            auto [distance, station] = queue.top();
+            queue.pop();
+            if(distance > witness[station]){
+                continue;
+            }
+            if(distance > limit){
+                break;
+            }
+            ++settled;
+            for(std::uint32_t e : out[station]){
+                StationHandle next = h.edges[e].to;
+                double length = distance + h.edges[e].length;
+                if(contracted[next] or next == skip or length >= witness[next]){
+                    continue;
+                }
+                if(witness[next] == unreached){
+                    reached.push_back(next);
+                }
+                witness[next] = length;
+                queue.push( { length, next } );
+            }
+        }
+    };
+
+    // palauttaa tarvittavien oikopolkujen määrän, ja lisää ne jos simulate on false
+    auto contract = [&](StationHandle v, bool simulate){
+        int shortcuts = 0;
+        for(size_t i = 0; i < in[v].size(); ++i){
+            HierarchyEdge incoming = h.edges[in[v][i]];
+            StationHandle u = incoming.from;
+            if(contracted[u]){
+                continue;
+            }
+            double limit = -1;
+            for(std::uint32_t e : out[v]){
+                HierarchyEdge const& outgoing = h.edges[e];
+                if(!contracted[outgoing.to] and outgoing.to != u){
+                    limit = max(limit, incoming.length + outgoing.length);
+                }
+            }
+            if(limit < 0){
+                continue;
+            }
+            witness_search(u, v, limit);
+
+            for(size_t j = 0; j < out[v].size(); ++j){
+                HierarchyEdge outgoing = h.edges[out[v][j]];
+                StationHandle w = outgoing.to;
+                double length = incoming.length + outgoing.length;
+                if(contracted[w] or w == u or witness[w] <= length){
+                    continue;
+                }
+                ++shortcuts;
+                if(!simulate){
+                    out[u].push_back(h.edges.size());
+                    in[w].push_back(h.edges.size());
+                    h.edges.push_back( { u, w, length, NO_TRIP, in[v][i], out[v][j] } );
+                }
+            }
+        }
+        return shortcuts;
+    };
+
+    // supistettujen kaarten listat sisältävät vain jäljellä olevia naapureita
+    auto priority = [&](StationHandle v){
+        int degree = in[v].size() + out[v].size();
+        return 2 * (contract(v, true) - degree) + contracted_neighbors[v] + level[v];
+    };
+
+    // supistusjärjestys laiskasti päivitettävällä prioriteettijonolla
+    priority_queue<pair<int, StationHandle>, vector<pair<int, StationHandle>>, greater<pair<int, StationHandle>>> order;
+    for(StationHandle station = 0; station < n; ++station){
+        order.push( { priority(station), station } );
+    }
+    h.rank.assign(n, 0);
+    std::uint32_t next_rank = 0;
+    while(!order.empty()){
+        StationHandle v = order.top().second;
+        order.pop();
+        int current = priority(v);
+        if(!order.empty() and current > order.top().first){
+            order.push( { current, v } );
+            continue;
+        }
+        contract(v, false);
+        contracted[v] = true;
+        h.rank[v] = next_rank++;
+
+        // supistetun aseman kaaret poistetaan naapureiden listoilta, jotta
+        // myöhemmät todistajahaut käyvät läpi vain jäljellä olevan verkon
+        auto touches_v = [&h, v](std::uint32_t e){ return h.edges[e].from == v or h.edges[e].to == v; };
+        for(std::uint32_t e : in[v]){
+            StationHandle u = h.edges[e].from;
+            if(!contracted[u]){
+                ++contracted_neighbors[u];
+                level[u] = max(level[u], level[v] + 1);
+                out[u].erase(remove_if(out[u].begin(), out[u].end(), touches_v), out[u].end());
+            }
+        }
+        for(std::uint32_t e : out[v]){
+            StationHandle w = h.edges[e].to;
+            if(!contracted[w]){
+                ++contracted_neighbors[w];
+                level[w] = max(level[w], level[v] + 1);
+                in[w].erase(remove_if(in[w].begin(), in[w].end(), touches_v), in[w].end());
+            }
+        }
+        in[v].clear();
+        out[v].clear();
+    }
+
+    // hakuverkot: ylöspäin lähtöaseman mukaan, alaspäin kohdeaseman mukaan
+    h.up_offsets.assign(n + 1, 0);
+    h.down_offsets.assign(n + 1, 0);
+    for(HierarchyEdge const& edge : h.edges){
+        if(h.rank[edge.to] > h.rank[edge.from]){
+            ++h.up_offsets[edge.from + 1];
+        }
+        else{
+            ++h.down_offsets[edge.to + 1];
+        }
+    }
+    for(size_t i = 1; i <= n; ++i){
+        h.up_offsets[i] += h.up_offsets[i - 1];
+        h.down_offsets[i] += h.down_offsets[i - 1];
+    }
+    h.up.resize(h.up_offsets[n]);
+    h.down.resize(h.down_offsets[n]);
+    vector<size_t> next_up(h.up_offsets.begin(), h.up_offsets.end() - 1);
+    vector<size_t> next_down(h.down_offsets.begin(), h.down_offsets.end() - 1);
+    for(std::uint32_t e = 0; e < h.edges.size(); ++e){
+        HierarchyEdge const& edge = h.edges[e];
+        if(h.rank[edge.to] > h.rank[edge.from]){
+            h.up[next_up[edge.from]++] = e;
+        }
+        else{
+            h.down[next_down[edge.to]++] = e;
+        }
+    }
+
+    h.forward_distance.assign(n, unreached);
+    h.backward_distance.assign(n, unreached);
+    h.forward_edge.assign(n, NO_EDGE);
+    h.backward_edge.assign(n, NO_EDGE);
+    return h;
+}
+
+/**
+ * @brief Datastructures::update_hierarchy
+ * ottaa valmistuneen taustarakennuksen tuloksen käyttöön. Jos verkko on
+ * muuttunut, taustatilassa käynnistetään uusi rakennus, muuten hierarkia
+ * rakennetaan heti vain pyydettäessä, jotta haku ei joudu odottamaan sitä.
+ * @param rebuild true, jos vanhentunut hierarkia rakennetaan heti uudelleen
+ * @return true, jos hierarkia vastaa nykyistä verkkoa
+ */
+bool Datastructures::update_hierarchy(bool rebuild){
+    update_graph();
+    if(hierarchy_future.valid() and
+       hierarchy_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready){
+        hierarchy = hierarchy_future.get();
+    }
+    if(hierarchy.version == graph_version){
+        return true;
+    }
+    if(!hierarchy_background){
+        if(rebuild){
+            hierarchy = build_hierarchy(graph_snapshot());
+        }
+        return rebuild;
+    }
+    // vanhentunut rakennus saa valmistua ensin, jotta futuren tuhoaja ei jää odottamaan
+    if(!hierarchy_future.valid()){
+        hierarchy_future = std::async(std::launch::async,
+                                      [graph = graph_snapshot()](){ return build_hierarchy(graph); });
+    }
+    return false;
+}
+
+/**
+ * @brief Datastructures::hierarchy_route
+ * kaksisuuntainen haku reittihierarkiassa: lähtöasemalta edetään ylöspäin
+ * meneviä kaaria, määränpäästä alaspäin tulevia kaaria takaperin. Haku loppuu,
+ * kun kummankaan jonon pienin etäisyys ei voi enää parantaa parasta
+ * kohtaamista. Oikopolut puretaan lopuksi alkuperäisiksi kaariksi.
+ * @param from lähtöaseman kahva
+ * @param to määränpään kahva
+ * @return kuten route_shortest_distance
+ */
+std::vector<std::tuple<StationID, TrainID, Distance>> Datastructures::hierarchy_route(StationHandle from, StationHandle to){
+    double const unreached = std::numeric_limits<double>::infinity();
+    RouteHierarchy& h = hierarchy;
+
+    using Entry = pair<double, StationHandle>;
+    priority_queue<Entry, vector<Entry>, greater<Entry>> forward;
+    priority_queue<Entry, vector<Entry>, greater<Entry>> backward;
+    h.forward_distance[from] = 0;
+    h.backward_distance[to] = 0;
+    h.touched.push_back(from);
+    h.touched.push_back(to);
+    forward.push( { 0, from } );
+    backward.push( { 0, to } );
+
+    double best = unreached;
+    StationHandle meeting = NO_STATION_HANDLE;
+    while(!forward.empty() or !backward.empty()){
+        bool forward_turn = backward.empty() or
+                (!forward.empty() and forward.top().first <= backward.top().first);
+        auto& queue = forward_turn ? forward : backward;
+        auto [distance, station] = queue.top();
+        if(distance >= best){
+            break;
+        }
+        queue.pop();
+
+        vector<double>& own = forward_turn ? h.forward_distance : h.backward_distance;
+        vector<double>& other = forward_turn ? h.backward_distance : h.forward_distance;
+        if(distance > own[station]){
+            continue;
+        }
+        if(distance + other[station] < best){
+            best = distance + other[station];
+            meeting = station;
+        }
+
+        // pysäytys (stall-on-demand): jos korkeammalta asemalta pääsee tänne
+        // lyhyemmin, asema ei voi olla lyhimmällä polulla eikä sitä laajenneta
+        size_t stall_begin = forward_turn ? h.down_offsets[station] : h.up_offsets[station];
+        size_t stall_end = forward_turn ? h.down_offsets[station + 1] : h.up_offsets[station + 1];
+        bool stalled = false;
+        for(size_t i = stall_begin; i < stall_end and !stalled; ++i){
+            HierarchyEdge const& edge = h.edges[forward_turn ? h.down[i] : h.up[i]];
+            StationHandle higher = forward_turn ? edge.from : edge.to;
+            stalled = own[higher] + edge.length < distance;
+        }
+        if(stalled){
+            continue;
+        }
+
+        size_t begin = forward_turn ? h.up_offsets[station] : h.down_offsets[station];
+        size_t end = forward_turn ? h.up_offsets[station + 1] : h.down_offsets[station + 1];
+        for(size_t i = begin; i < end; ++i){
+            std::uint32_t e = forward_turn ? h.up[i] : h.down[i];
+            HierarchyEdge const& edge = h.edges[e];
+            StationHandle next = forward_turn ? edge.to : edge.from;
+            double length = distance + edge.length;
+            if(length < own[next]){
+                if(own[next] == unreached){
+                    h.touched.push_back(next);
+                }
+                own[next] = length;
+                (forward_turn ? h.forward_edge : h.backward_edge)[next] = e;
+                queue.push( { length, next } );
+            }
+        }
+    }
+
+    // kohtaamiskohdasta kaaret molempiin suuntiin, oikopolut purettuna
+    vector<std::uint32_t> hops;
+    if(meeting != NO_STATION_HANDLE){
+        vector<std::uint32_t> pending;
+        for(StationHandle station = meeting; station != to; ){
+            std::uint32_t e = h.backward_edge[station];
+            pending.push_back(e);
+            station = h.edges[e].to;
+        }
+        reverse(pending.begin(), pending.end());
+        for(StationHandle station = meeting; station != from; ){
+            std::uint32_t e = h.forward_edge[station];
+            pending.push_back(e);
+            station = h.edges[e].from;
+        }
+        // pino: seuraavaksi käsiteltävä kaari on lopussa
+        while(!pending.empty()){
+            std::uint32_t e = pending.back();
+            pending.pop_back();
+            if(h.edges[e].first == NO_EDGE){
+                hops.push_back(e);
+            }
+            else{
+                pending.push_back(h.edges[e].second);
+                pending.push_back(h.edges[e].first);
+            }
+        }
+    }
+
+    for(StationHandle station : h.touched){
+        h.forward_distance[station] = unreached;
+        h.backward_distance[station] = unreached;
+    }
+    h.touched.clear();
+
+    vector<tuple<StationID, TrainID, Distance>> vec;
+    if(meeting == NO_STATION_HANDLE){
+        return vec;
+    }
+    double travelled = 0;
+    for(std::uint32_t e : hops){
+        HierarchyEdge const& edge = h.edges[e];
+        vec.push_back( { station_ids[edge.from], trip_ids[edge.trip], static_cast<Distance>(travelled) } );
+        travelled += edge.length;
+    }
+    vec.push_back( { station_ids[to], NO_TRAIN, static_cast<Distance>(travelled) } );
+    return vec;
+}
+
+/**
+ * @brief Datastructures::merge_departures
+ * järjestää aseman lisäyspuskurin ja lomittaa sen järjestettyyn lähtövektoriin
+ * @param station aseman kahva
+ */
+void Datastructures::merge_departures(StationHandle station){
+    pmr::vector<Departure>& pending = station_pending_departures[station];
+    if(pending.empty()){
+        return;
+    }
+    pmr::vector<Departure>& departures = station_departures[station];
+    sort(pending.begin(), pending.end());
+
+    size_t middle = departures.size();
+    departures.insert(departures.end(), make_move_iterator(pending.begin()), make_move_iterator(pending.end()));
+    pending.clear();
+    inplace_merge(departures.begin(), departures.begin() + middle, departures.end());
+}
+
+/**
+ * @brief Datastructures::has_departure
+ * tarkistaa onko asemalla jo annettu lähtö, järjestetystä osasta
+ * binäärihaulla ja lisäyspuskurista läpikäymällä
+ * @param station aseman kahva
+ * @param departure lähtö (aika, juna)
+ * @return true, jos lähtö on jo olemassa
+ */
+bool Datastructures::has_departure(StationHandle station, Departure const& departure){
+    pmr::vector<Departure> const& departures = station_departures[station];
+    if(binary_search(departures.begin(), departures.end(), departure)){
+        return true;
+    }
+    pmr::vector<Departure> const& pending = station_pending_departures[station];
+    return find(pending.begin(), pending.end(), departure) != pending.end();
+}
+
+/**
+ * @brief Datastructures::find_station
+ * hakee aseman kahvan, jolla sen tiedot löytyvät sarakkeista
+ * @param id aseman id
+ * @return aseman kahva, NO_STATION_HANDLE jos asemaa ei ole olemassa
+ */
+StationHandle Datastructures::find_station(StationID const& id){
+    auto it = stations.find(id);
+    if(it == stations.end()){
+        return NO_STATION_HANDLE;
+    }
+    return make_handle(it->second);
+}
+
+
+/**
+ * @brief Datastructures::update_ancestors
+ * asettaa alueen syvyyden ja esivanhempitaulun uuden vanhemman mukaan,
+ * vanhemman taulun pitää olla jo ajan tasalla
+ * @param region alue
+ * @param parent alueen vanhempi, nullptr jos alue on juuri
+ */
+void Datastructures::update_ancestors(RegionInfo& region, RegionInfo* parent)
+{
+    region.ancestors.clear();
+    region.depth = parent ? parent->depth + 1 : 0;
+    // 2^(k+1):s esivanhempi on 2^k:nnen esivanhemman 2^k:s esivanhempi
+    for(RegionInfo* up = parent; up != nullptr; ){
+        size_t k = region.ancestors.size();
+        region.ancestors.push_back(up);
+        up = k < up->ancestors.size() ? up->ancestors[k] : nullptr;
+    }
+}
+
+/**
+ * @brief Datastructures::lift_region
+ * nousee alueesta esivanhempiin annetulle syvyydelle
+ * @param region alue
+ * @param depth haluttu syvyys, enintään alueen oma syvyys
+ * @return alueen esivanhempi syvyydellä depth
+ */
+Datastructures::RegionInfo* Datastructures::lift_region(RegionInfo* region, unsigned int depth)
+{
+    for(unsigned int steps = region->depth - depth, k = 0; steps != 0; steps >>= 1, ++k){
+        if(steps & 1){
+            region = region->ancestors[k];
+        }
+    }
+    return region;
+}
+
+/**
+ * @brief Datastructures::update_region_order
+ * rakentaa region_order:n uudelleen, jos alueita on lisätty: jokaisesta
+ * juurialueesta syvyyshaku, jossa alueen alipuu saa yhtenäisen välin
+ */
+void Datastructures::update_region_order()
+{
+    if(!region_order_dirty){
+        return;
+    }
+    region_order.clear();
+    region_order.reserve(vec_all_regions.size());
+    // pinossa (alue, seuraavan lapsen indeksi)
+    vector<pair<RegionInfo*, size_t>> stack;
+    for(RegionID rootid : vec_all_regions){
+        RegionInfo* root = regions.at(rootid).get();
+        if(root->parentRegion != NO_REGION){
+            continue;
+        }
+        root->subtreeBegin = region_order.size();
+        region_order.push_back(rootid);
+        stack.push_back( { root, 0 } );
+        while(!stack.empty()){
+            auto& [region, next] = stack.back();
+            if(next < region->childRegions.size()){
+                RegionInfo* child = region->childRegions[next++];
+                child->subtreeBegin = region_order.size();
+                region_order.push_back(child->regionId);
+                stack.push_back( { child, 0 } );
+            }
+            else{
+                region->subtreeEnd = region_order.size();
+                stack.pop_back();
+            }
+        }
+    }
+    region_order_dirty = false;
+}
+
+/**
+ * @brief Datastructures::regions_containing
+ * etsii alueet, joiden rajojen sisällä piste on. R-puusta käydään läpi vain
+ * solmut, joiden suorakulmio sisältää pisteen, ja tarkka monikulmiotesti
+ * tehdään vain niille alueille, joiden oma suorakulmio sisältää pisteen.
+ * @param xy koordinaatti
+ * @return pisteen sisältävät alueet id:n mukaan järjestettynä
+ */
+std::vector<RegionID> Datastructures::regions_containing(Coord xy)
+{
+    update_rtree();
+    vector<RegionInfo*> found;
+    rtree_regions_containing(xy, found);
+    vector<RegionID> vec;
+    vec.reserve(found.size());
+    for(RegionInfo const* region : found){
+        vec.push_back(region->regionId);
+    }
+    sort(vec.begin(), vec.end());
+    return vec;
+}
+
+/**
+ * @brief Datastructures::assign_stations_to_regions
+ * liittää jokaisen alueettoman aseman pienimpään alueeseen, jonka rajojen
+ * sisällä asema on. R-puu pakataan ensin, minkä jälkeen säikeet hakevat
+ * asemille alueet paloittain vain lukien. Liitokset tehdään lopuksi yhdessä
+ * säikeessä, koska ne päivittävät alueiden asemalistoja ja laskureita.
+ * Liitetyt asemat siirtyvät change_station_coord:ssa uuteen alueeseen.
+ * @param threads säikeiden määrä, 0 = laitteiston säikeiden määrä
+ * @return liitettyjen asemien määrä
+ */
+int Datastructures::assign_stations_to_regions(unsigned int threads)
+{
+    update_rtree();
+    size_t count = station_ids.size();
+    vector<RegionInfo*> found(count, nullptr);
+
+    static constexpr size_t CHUNK = 1024;
+    size_t chunks = (count + CHUNK - 1) / CHUNK;
+    if(threads == 0){
+        threads = max(1u, std::thread::hardware_concurrency());
+    }
+    threads = max<size_t>(1, min<size_t>(threads, chunks));
+
+    std::atomic<size_t> next_chunk{0};
+    auto worker = [&](){
+        for(size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++){
+            for(StationHandle station = chunk * CHUNK; station < min(count, (chunk + 1) * CHUNK); ++station){
+                if(station_index[station] != NO_INDEX and station_regions[station] == NO_REGION){
+                    found[station] = smallest_region_containing(station_coords[station]);
+                }
+            }
+        }
+    };
+    vector<std::thread> workers;
+    for(unsigned int i = 1; i < threads; ++i){
+        workers.emplace_back(worker);
+    }
+    worker();
+    for(std::thread& thread : workers){
+        thread.join();
+    }
+
+    int assigned = 0;
+    for(StationHandle station = 0; station < count; ++station){
+        if(found[station] != nullptr){
+            attach_station_to_region(station, found[station]->regionId, true);
+            ++assigned;
+        }
+    }
+    return assigned;
+}
+
+/**
+ * @brief Datastructures::rtree_regions_containing
+ * käy läpi R-puun solmut, joiden suorakulmio sisältää pisteen, ja tekee
+ * tarkan monikulmiotestin vain alueille, joiden oma suorakulmio sisältää
+ * pisteen. Ei muuta tietorakennetta, puu pitää pakata ennen kutsua.
+ * @param xy koordinaatti
+ * @param out vektori, johon pisteen sisältävät alueet lisätään
+ */
+void Datastructures::rtree_regions_containing(Coord xy, vector<RegionInfo*>& out) const
+{
+    if(rtree_nodes.empty()){
+        return;
+    }
+    auto covers = [xy](Coord low, Coord high){
+        return low.x <= xy.x and xy.x <= high.x and low.y <= xy.y and xy.y <= high.y;
+    };
+    vector<std::uint32_t> stack{ static_cast<std::uint32_t>(rtree_nodes.size() - 1) };
+    while(!stack.empty()){
+        RTreeNode const& node = rtree_nodes[stack.back()];
+        stack.pop_back();
+        if(!covers(node.low, node.high)){
+            continue;
+        }
+        for(std::uint32_t i = node.first; i < node.first + node.count; ++i){
+            if(!node.leaf){
+                stack.push_back(i);
+                continue;
+            }
+            RegionInfo* region = rtree_regions[i];
+            if(covers(region->boundsLow, region->boundsHigh) and polygon_contains(*region, xy)){
+                out.push_back(region);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::smallest_region_containing
+ * etsii pinta-alaltaan pienimmän alueen, jonka sisällä piste on,
+ * samankokoisista pienimmän id:n. Puu pitää pakata ennen kutsua.
+ * @param xy koordinaatti
+ * @return alue, nullptr jos mikään alue ei sisällä pistettä
+ */
+Datastructures::RegionInfo* Datastructures::smallest_region_containing(Coord xy) const
+{
+    vector<RegionInfo*> found;
+    rtree_regions_containing(xy, found);
+    RegionInfo* smallest = nullptr;
+    for(RegionInfo* region : found){
+        if(smallest == nullptr or make_pair(llabs(region->doubleArea), region->regionId) <
+                make_pair(llabs(smallest->doubleArea), smallest->regionId)){
+            smallest = region;
+        }
+    }
+    return smallest;
+}
+
+/**
+ * @brief Datastructures::attach_station_to_region
+ * liittää alueettoman aseman alueeseen ja lisää aseman osuuden laskureihin
+ * @param station aseman kahva
+ * @param parentid alueen id, alueen pitää olla olemassa
+ * @param automatic true, jos asema liitettiin sijaintinsa perusteella ja
+ * seuraa siksi rajoja change_station_coord:ssa
+ */
+void Datastructures::attach_station_to_region(StationHandle station, RegionID parentid, bool automatic)
+{
+    station_regions[station] = parentid;
+    station_auto_regions[station] = automatic;
+    pmr::vector<StationHandle>& members = regions.at(parentid)->regionStations;
+    station_region_slots[station] = members.size();
+    members.push_back(station);
+    add_region_totals(parentid, 1, station_departures[station].size() + station_pending_departures[station].size());
+}
+
+/**
+ * @brief Datastructures::detach_station_from_region
+ * irrottaa aseman alueestaan: alueen asemista viimeinen siirretään aseman
+ * paikalle ja laskureista vähennetään aseman osuus
+ * @param station aseman kahva
+ */
+void Datastructures::detach_station_from_region(StationHandle station)
+{
+    if(station_regions[station] == NO_REGION){
+        return;
+    }
+    pmr::vector<StationHandle>& members = regions.at(station_regions[station])->regionStations;
+    size_t slot = station_region_slots[station];
+    members[slot] = members.back();
+    station_region_slots[members[slot]] = slot;
+    members.pop_back();
+    add_region_totals(station_regions[station], -1,
+                      -static_cast<int>(station_departures[station].size() + station_pending_departures[station].size()));
+    station_regions[station] = NO_REGION;
+}
+
+/**
+ * @brief Datastructures::update_rtree
+ * pakkaa R-puun uudelleen, jos alueita on lisätty. Jokaisella tasolla
+ * laatikot järjestetään keskipisteen x:n mukaan pystysuikaleiksi, suikaleet
+ * y:n mukaan, ja peräkkäiset RTREE_FANOUT laatikkoa saavat yhteisen vanhemman.
+ */
+void Datastructures::update_rtree()
+{
+    if(!rtree_dirty){
+        return;
+    }
+    rtree_dirty = false;
+    update_polygon_cache();
+    rtree_nodes.clear();
+    rtree_regions.clear();
+
+    // järjestää [begin, end) STR-järjestykseen laatikon keskipisteen mukaan
+    auto tile = [](auto begin, auto end, auto low, auto high){
+        size_t count = end - begin;
+        size_t groups = (count + RTREE_FANOUT - 1) / RTREE_FANOUT;
+        size_t slice = RTREE_FANOUT * static_cast<size_t>(ceil(sqrt(static_cast<double>(groups))));
+        auto center_x = [&](auto const& a){ return static_cast<long long int>(low(a).x) + high(a).x; };
+        auto center_y = [&](auto const& a){ return static_cast<long long int>(low(a).y) + high(a).y; };
+        sort(begin, end, [&](auto const& a, auto const& b){ return center_x(a) < center_x(b); });
+        for(auto it = begin; it < end; it += min(slice, static_cast<size_t>(end - it))){
+            auto slice_end = it + min(slice, static_cast<size_t>(end - it));
+            sort(it, slice_end, [&](auto const& a, auto const& b){ return center_y(a) < center_y(b); });
+        }
+    };
+
+    for(RegionID id : vec_all_regions){
+        rtree_regions.push_back(regions.at(id).get());
+    }
+    if(rtree_regions.empty()){
+        return;
+    }
+    tile(rtree_regions.begin(), rtree_regions.end(),
+         [](RegionInfo const* r){ return r->boundsLow; }, [](RegionInfo const* r){ return r->boundsHigh; });
+
+    // kokoaa peräkkäiset lapset [first, first + count) yhdeksi solmuksi
+    auto group = [](auto begin, std::uint32_t first, std::uint32_t count, bool leaf, auto low, auto high){
+        RTreeNode node{ low(begin[0]), high(begin[0]), first, count, leaf };
+        for(std::uint32_t i = 1; i < count; ++i){
+            node.low = { min(node.low.x, low(begin[i]).x), min(node.low.y, low(begin[i]).y) };
+            node.high = { max(node.high.x, high(begin[i]).x), max(node.high.y, high(begin[i]).y) };
+        }
+        return node;
+    };
+
+    vector<RTreeNode> level;
+    for(size_t i = 0; i < rtree_regions.size(); i += RTREE_FANOUT){
+        std::uint32_t count = min(RTREE_FANOUT, rtree_regions.size() - i);
+        level.push_back(group(rtree_regions.begin() + i, i, count, true,
+                              [](RegionInfo const* r){ return r->boundsLow; }, [](RegionInfo const* r){ return r->boundsHigh; }));
+    }
+    auto node_low = [](RTreeNode const& n){ return n.low; };
+    auto node_high = [](RTreeNode const& n){ return n.high; };
+    while(level.size() > 1){
+        tile(level.begin(), level.end(), node_low, node_high);
+        size_t base = rtree_nodes.size();
+        rtree_nodes.insert(rtree_nodes.end(), level.begin(), level.end());
+        vector<RTreeNode> parents;
+        for(size_t i = 0; i < level.size(); i += RTREE_FANOUT){
+            std::uint32_t count = min(RTREE_FANOUT, level.size() - i);
+            parents.push_back(group(level.begin() + i, base + i, count, false, node_low, node_high));
+        }
+        level.swap(parents);
+    }
+    rtree_nodes.push_back(level.front());
+}
+
+/**
+ * @brief Datastructures::decode_polygon
+ * purkaa alueen kärjet polygon_bytes:sta järjestyksessä
+ * @param region alue
+ * @param emit kutsutaan jokaiselle kärjelle
+ */
+template <typename Emit>
+void Datastructures::decode_polygon(RegionInfo const& region, Emit emit) const
+{
+    std::uint8_t const* bytes = polygon_bytes.data() + region.verticesBegin;
+    long long int x = 0;
+    long long int y = 0;
+    for(std::uint32_t i = 0; i < region.vertexCount; ++i){
+        x += read_varint(bytes);
+        y += read_varint(bytes);
+        emit(Coord{ static_cast<int>(x), static_cast<int>(y) });
+    }
+}
+
+/**
+ * @brief Datastructures::update_polygon_cache
+ * purkaa uusien alueiden kärjet polygon_x/polygon_y -taulukoihin
+ * monikulmiotestiä varten, ensimmäinen kärki toistetaan lopussa
+ */
+void Datastructures::update_polygon_cache()
+{
+    for(; polygon_cached_regions < vec_all_regions.size(); ++polygon_cached_regions){
+        RegionInfo& region = *regions.at(vec_all_regions[polygon_cached_regions]);
+        region.polygonBegin = polygon_x.size();
+        decode_polygon(region, [this](Coord xy){
+            polygon_x.push_back(xy.x);
+            polygon_y.push_back(xy.y);
+        });
+        if(region.vertexCount > 0){
+            polygon_x.push_back(polygon_x[region.polygonBegin]);
+            polygon_y.push_back(polygon_y[region.polygonBegin]);
+        }
+        region.polygonEnd = polygon_x.size();
+    }
+}
+
+/**
+ * @brief Datastructures::polygon_contains
+ * ristiinlaskentatesti alueen kärjille yhteisestä kärkitaulukosta, nopein
+ * käytettävissä oleva ydin valitaan ensimmäisellä kutsulla
+ * @param region alue
+ * @param xy koordinaatti
+ * @return true, jos piste on alueen rajojen sisällä
+ */
+bool Datastructures::polygon_contains(RegionInfo const& region, Coord xy) const
+{
+    static CrossingKernel const fastest = crossing_kernels().back().second;
+    if(region.polygonEnd - region.polygonBegin < 4){
+        return false;
+    }
+    return fastest(polygon_x.data() + region.polygonBegin, polygon_y.data() + region.polygonBegin,
+                   region.polygonEnd - region.polygonBegin - 1, xy);
+}
+
+/**
+ * @brief Datastructures::polygon_kernel_benchmark
+ * mittaa monikulmiotestin ytimet: samat satunnaiset pisteet alueiden
+ * suorakulmioista testataan jokaisella ytimellä kaikkiin alueisiin, minkä
+ * jälkeen jokaisen ytimen vastausta verrataan pisteittäin skalaariytimeen
+ * @param points pisteiden määrä alueittain
+ * @return (ytimen nimi, aika sekunteina, sisällä olleiden pisteiden määrä,
+ * skalaariytimestä poikenneiden pisteiden määrä) jokaiselle käytettävissä olevalle ytimelle
+ */
+std::vector<std::tuple<std::string, double, int, int>> Datastructures::polygon_kernel_benchmark(unsigned int points)
+{
+    update_polygon_cache();
+    vector<pair<RegionInfo const*, Coord>> samples;
+    samples.reserve(vec_all_regions.size() * points);
+    for(RegionID id : vec_all_regions){
+        RegionInfo const& region = *regions.at(id);
+        for(unsigned int i = 0; i < points and region.polygonEnd - region.polygonBegin >= 4; ++i){
+            samples.push_back( { &region, { random_in_range(region.boundsLow.x, region.boundsHigh.x),
+                                            random_in_range(region.boundsLow.y, region.boundsHigh.y) } } );
+        }
+    }
+
+    auto kernels = crossing_kernels();
+    CrossingKernel const scalar = kernels.front().second;
+    vector<tuple<std::string, double, int, int>> vec;
+    for(auto const& [name, kernel] : kernels){
+        int inside = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(auto const& [region, xy] : samples){
+            inside += kernel(polygon_x.data() + region->polygonBegin, polygon_y.data() + region->polygonBegin,
+                             region->polygonEnd - region->polygonBegin - 1, xy);
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // vertailu ajetaan ajanoton ulkopuolella
+        int mismatches = 0;
+        for(auto const& [region, xy] : samples){
+            int const* xs = polygon_x.data() + region->polygonBegin;
+            int const* ys = polygon_y.data() + region->polygonBegin;
+            size_t edges = region->polygonEnd - region->polygonBegin - 1;
+            mismatches += kernel(xs, ys, edges, xy) != scalar(xs, ys, edges, xy);
+        }
+        vec.push_back( { name, elapsed, inside, mismatches } );
+    }
+    return vec;
+}
+
+/**
+ * @brief Datastructures::add_region_totals
+ * lisää alueen ja kaikkien sen esivanhempien laskureihin
+ * @param id alue, NO_REGION jos asema ei kuulu alueeseen (ei tehdä mitään)
+ * @param stations asemien määrän muutos
+ * @param departures lähtöjen määrän muutos
+ */
+void Datastructures::add_region_totals(RegionID id, int stations, int departures)
+{
+    if(id == NO_REGION){
+        return;
+    }
+    for(RegionInfo* region = regions.at(id).get(); region != nullptr;
+        region = region->ancestors.empty() ? nullptr : region->ancestors[0]){
+        region->stationCount += stations;
+        region->departureCount += departures;
+    }
+}
 
 /**
  * @brief Datastructures::regionExists
@@ -550,16 +2976,198 @@ bool Datastructures::regionExists(RegionID id){
     return regions.find(id) != regions.end();
 }
 
+/**
+ * @brief Datastructures::distance_key
+ * muodostaa stations_by_distance -joukon avaimen: etäisyyden neliö
+ * origosta, y-koordinaatti ja aseman id
+ * @param xy aseman koordinaatti
+ * @param id aseman id
+ * @return avain, jonka järjestys vastaa etäisyysjärjestystä
+ */
+Datastructures::DistanceKey Datastructures::distance_key(Coord xy, StationID const& id){
+    long long int x = xy.x;
+    long long int y = xy.y;
+    return {x*x + y*y, xy.y, id};
+}
 
 /**
- * @brief Datastructures::calc_distance
- * laskee annetun koordinaatin ja aseman välisen etäisyyden
- * @param xy koordinaatti
- * @param id asema
- * @return annetun koordinaatin ja aseman etäisyys
+ * @brief Datastructures::erase_coord_index
+ * poistaa aseman stations_by_coord -hajautustaulusta
+ * @param xy aseman koordinaatti
+ * @param station poistettavan aseman kahva
+ */
+void Datastructures::erase_coord_index(Coord xy, StationHandle station){
+    auto range = stations_by_coord.equal_range(xy);
+    for(auto it = range.first; it != range.second; ++it){
+        if(it->second == station){
+            stations_by_coord.erase(it);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::kd_insert
+ * lisää aseman k-d -puuhun kulkemalla juuresta lehteen, jos polku
+ * on liian pitkä, puu rakennetaan uudelleen tasapainoiseksi
+ * @param station lisättävän aseman kahva
+ * @param xy aseman koordinaatti
+ */
+void Datastructures::kd_insert(StationHandle station, Coord xy){
+    int index = kd_nodes.size();
+    kd_nodes.push_back({xy, station});
+    station_kd_nodes[station] = index;
+
+    if(kd_root == -1){
+        kd_root = index;
+        return;
+    }
+
+    int node = kd_root;
+    int depth = 0;
+    while(true){
+        KdNode& current = kd_nodes[node];
+        bool less = (depth % 2 == 0) ? xy.x < current.xy.x : xy.y < current.xy.y;
+        int& child = less ? current.left : current.right;
+        ++depth;
+        if(child == -1){
+            child = index;
+            break;
+        }
+        node = child;
+    }
+
+    // tasapainoisen puun syvyys on noin log2(n), sallitaan kaksinkertainen
+    size_t live = kd_nodes.size() - kd_removed;
+    int limit = 4;
+    while(live > 1){
+        live /= 2;
+        limit += 2;
+    }
+    if(depth > limit or kd_removed * 2 >= kd_nodes.size()){
+        kd_rebuild();
+    }
+}
+
+/**
+ * @brief Datastructures::kd_remove
+ * merkitsee aseman solmun poistetuksi k-d -puussa, kutsujan vastuulla
+ * on rakentaa puu uudelleen, kun poistettuja solmuja on liikaa
+ * @param station poistettavan aseman kahva
+ */
+void Datastructures::kd_remove(StationHandle station){
+    kd_nodes[station_kd_nodes[station]].removed = true;
+    station_kd_nodes[station] = -1;
+    ++kd_removed;
+}
+
+/**
+ * @brief Datastructures::kd_rebuild
+ * rakentaa k-d -puun uudelleen käymällä koordinaattisarakkeen läpi,
+ * jakamalla solmut aina mediaanin kohdalta
+ */
+void Datastructures::kd_rebuild(){
+    kd_nodes.clear();
+    kd_nodes.reserve(vec_all_stations.size());
+    for(StationHandle station = 0; station < station_coords.size(); ++station){
+        if(station_index[station] != NO_INDEX){
+            kd_nodes.push_back({station_coords[station], station});
+        }
+    }
+    kd_removed = 0;
+
+    vector<int> order(kd_nodes.size());
+    for(size_t i = 0; i < order.size(); ++i){
+        order[i] = i;
+    }
+    kd_root = kd_build(order, 0, order.size(), 0);
+
+    for(size_t i = 0; i < kd_nodes.size(); ++i){
+        station_kd_nodes[kd_nodes[i].station] = i;
+    }
+}
+
+/**
+ * @brief Datastructures::kd_build
+ * rakentaa rekursiivisesti tasapainoisen alipuun solmuista nodes[begin, end)
+ * @param nodes solmujen indeksit
+ * @param begin alueen alku
+ * @param end alueen loppu
+ * @param depth alipuun juuren syvyys, määrää jakoakselin
+ * @return alipuun juuren indeksi, -1 jos alue on tyhjä
+ */
+int Datastructures::kd_build(vector<int>& nodes, size_t begin, size_t end, int depth){
+    if(begin >= end){
+        return -1;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    bool x_axis = depth % 2 == 0;
+    nth_element(nodes.begin() + begin, nodes.begin() + mid, nodes.begin() + end,
+                [this, x_axis](int a, int b)
+                {return x_axis ? kd_nodes[a].xy.x < kd_nodes[b].xy.x
+                               : kd_nodes[a].xy.y < kd_nodes[b].xy.y;});
+
+    int root = nodes[mid];
+    kd_nodes[root].left = kd_build(nodes, begin, mid, depth + 1);
+    kd_nodes[root].right = kd_build(nodes, mid + 1, end, depth + 1);
+    return root;
+}
+
+/**
+ * @brief Datastructures::kd_closer
+ * vertaa kahta (etäisyyden neliö, kahva) -paria, samalla
+ * etäisyydellä olevista lähempänä on se, jonka id on pienempi
+ * @return true, jos a on lähempänä kuin b
+ */
+bool Datastructures::kd_closer(pair<long long int, StationHandle> const& a,
+                               pair<long long int, StationHandle> const& b){
+    if(a.first != b.first){
+        return a.first < b.first;
+    }
+    return station_ids[a.second] < station_ids[b.second];
+}
+
+/**
+ * @brief Datastructures::kd_search
+ * etsii alipuusta k lähintä asemaa, best on max-keko pareista
+ * (etäisyyden neliö, kahva), joten sen huippu on huonoin löydetty
+ * @param node alipuun juuri
+ * @param depth alipuun juuren syvyys
+ * @param xy koordinaatti, jonka lähimmät asemat halutaan
+ * @param k haluttujen asemien määrä
+ * @param best tähän asti löydetyt lähimmät asemat
  */
-int Datastructures::calc_distance(Coord xy, StationID id){
-    Coord station_xy =  stations.at(id)->stationCoord;
-    return sqrt(pow(xy.x-station_xy.x,2)+pow(xy.y-station_xy.y,2));
+void Datastructures::kd_search(int node, int depth, Coord xy, size_t k,
+                               vector<pair<long long int, StationHandle>>& best){
+    if(node == -1){
+        return;
+    }
+    KdNode const& current = kd_nodes[node];
+
+    if(!current.removed){
+        // erotus lasketaan leveänä, jottei kaukaisten koordinaattien erotus ylivuoda
+        long long int dx = static_cast<long long int>(xy.x) - current.xy.x;
+        long long int dy = static_cast<long long int>(xy.y) - current.xy.y;
+        pair<long long int, StationHandle> candidate = {dx*dx + dy*dy, current.station};
+        auto closer = [this](auto const& a, auto const& b){ return kd_closer(a, b); };
+        if(best.size() < k){
+            best.push_back(candidate);
+            push_heap(best.begin(), best.end(), closer);
+        } else if(kd_closer(candidate, best.front())){
+            pop_heap(best.begin(), best.end(), closer);
+            best.back() = candidate;
+            push_heap(best.begin(), best.end(), closer);
+        }
+    }
+
+    long long int diff = (depth % 2 == 0) ? static_cast<long long int>(xy.x) - current.xy.x
+                                          : static_cast<long long int>(xy.y) - current.xy.y;
+    int near = diff < 0 ? current.left : current.right;
+    int far = diff < 0 ? current.right : current.left;
 
+    kd_search(near, depth + 1, xy, k, best);
+    // toiselle puolelle mennään vain, jos sieltä voi löytyä yhtä lähellä oleva asema
+    if(best.size() < k or diff*diff <= best.front().first){
+        kd_search(far, depth + 1, xy, k, best);
+    }
 }
@@ -11,12 +11,15 @@
 #include <limits>
 #include <functional>
 #include <exception>
+#include <cstdint>
 
 #include <map>
 #include <unordered_map>
 #include <memory>
 #include <set>
 #include <unordered_set>
+#include <memory_resource>
+#include <future>
 using namespace std;
 
 
@@ -28,12 +31,18 @@ using RegionID = unsigned long long int;
 using Name = std::string;
 using Time = unsigned short int;
 
+// Type for a dense station handle (an interned StationID). The low 24 bits are the station's
+// slot in the internal columns and the high 8 bits a generation of that slot, so a handle
+// kept after its station was removed stays invalid instead of referring to a new station.
+using StationHandle = std::uint32_t;
+
 // Return values for cases where required thing was not found
 StationID const NO_STATION = "---";
 TrainID const NO_TRAIN = "---";
 RegionID const NO_REGION = -1;
 Name const NO_NAME = "!NO_NAME!";
 Time const NO_TIME = 9999;
+StationHandle const NO_STATION_HANDLE = std::numeric_limits<StationHandle>::max();
 
 // Return value for cases where integer values were not found
 int const NO_VALUE = std::numeric_limits<int>::min();
@@ -99,6 +108,33 @@ private:
 };
 
 
+// Vain luku -näkymä Datastructuresin sisäiseen taulukkoon ilman kopiointia.
+// Näkymä on voimassa niin kauan kuin tietorakenteen epookki ei ole muuttunut,
+// eli asemia tai alueita ei ole lisätty tai poistettu (ks. valid()).
+template <typename Type>
+class ConstView
+{
+public:
+    ConstView() = default;
+    ConstView(Type const* data, std::size_t size, unsigned long int const* epoch):
+        data_(data), size_(size), epoch_(epoch), created_(epoch ? *epoch : 0) {}
+
+    Type const* begin() const { return data_; }
+    Type const* end() const { return data_ + size_; }
+    Type const* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    Type const& operator[](std::size_t i) const { return data_[i]; }
+
+    bool valid() const { return epoch_ == nullptr or *epoch_ == created_; }
+
+private:
+    Type const* data_ = nullptr;
+    std::size_t size_ = 0;
+    unsigned long int const* epoch_ = nullptr;
+    unsigned long int created_ = 0;
+};
+
 // This is the class you are supposed to implement
 
 class Datastructures
@@ -113,8 +149,8 @@ public:
     unsigned int station_count();
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate:dokumentaation perusteella
-    //                              unordered_map ja vector::clear kompleksisuus on lineaarinen
+    // Short rationale for estimate: säiliöiden alkiot tuhotaan (lineaarinen), mutta muisti
+    //                               palautetaan poolille ja pooli vapauttaa sen kerralla
     void clear_all();
 
     // Estimate of performance: O(n)
@@ -124,57 +160,64 @@ public:
     // Estimate of performance: O(n)
     // Short rationale for estimate: tarkistaa ensin aseman olemassaolon O(N)
     //                               unordered_map::insert O(N), (keskimääräisesti vakio)
-    //                               vectoriin lisäys O(1)
+    //                               vectoriin lisäys O(1), set::insert O(logN) x2
     bool add_station(StationID id, Name const& name, Coord xy);
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate: etsii aseman O(N) ja
-    //                               unordered_map::at O(N)
+    // Short rationale for estimate: etsii aseman kahvan unordered_map::find O(N),
+    //                               (keskimääräisesti vakio), sarakkeen luku O(1)
     Name get_station_name(StationID id);
 
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate: etsii aseman O(N) ja
-    //                               unordered_map::at O(N)
+    // Short rationale for estimate: etsii aseman kahvan unordered_map::find O(N),
+    //                               (keskimääräisesti vakio), sarakkeen luku O(1)
     Coord get_station_coordinates(StationID id);
 
     // We recommend you implement the operations below only after implementing the ones above
 
-    // Estimate of performance: O(n^(2))
-    // Short rationale for estimate: sort O(NlogN), unordered_map::at O(N) ->O(N²)
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: stations_by_name on valmiiksi järjestyksessä,
+    //                               id:t kopioidaan siitä suoraan
     std::vector<StationID> stations_alphabetically();
 
-    // Estimate of performance: O(n^(2))
-    // Short rationale for estimate: sort O(NlogN), unordered_map::at O(N) ->O(N²)
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: stations_by_distance on valmiiksi järjestyksessä,
+    //                               id:t kopioidaan siitä suoraan
     std::vector<StationID> stations_distance_increasing();
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: käy läpi kaikki asemat ja vertaa niiden koordinaatteja annettuihin
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: unordered_multimap::equal_range keskimäärin vakio,
+    //                               samassa koordinaatissa on yleensä vain yksi asema
     StationID find_station_with_coord(Coord xy);
 
     // Estimate of performance: O(n)
     // Short rationale for estimate: tarkastaa aseman olemassaolon O(N), jonka jälkeen unordered_map::at O(N)
+    //                               stations_by_distance päivitys set::erase + set::insert O(logN)
+    //                               stations_by_coord päivitys keskimäärin O(1)
     bool change_station_coord(StationID id, Coord newcoord);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: tarkistaa aseman olemassaolon, jonka jälkeen lisäys
-    //                               tietorakenteeseen
+    // Estimate of performance: O(logn)
+    // Short rationale for estimate: binäärihaku järjestetystä osasta ja lisäys puskuriin,
+    //                               puskurin lomitus O(n) jakautuu DEPARTURE_BATCH lisäykselle,
+    //                               minuuttikoriin lisäys O(1)
     bool add_departure(StationID stationid, TrainID trainid, Time time);
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate: käyttää erase -algoritmia poistaakseen trainid:n
-    //                               tietorakenteesta
+    // Short rationale for estimate: binäärihaku ja vector::erase, joka siirtää loppuosaa,
+    //                               minuuttikorista poisto O(korin koko)
     bool remove_departure(StationID stationid, TrainID trainid, Time time);
 
-    // Estimate of performance: O(nlogn)
-    // Short rationale for estimate: käy läpi kaikki aseman ajat, ja kaikki junat ajalla, jos aika on suurempi kuin annettu
+    // Estimate of performance: O(logn + k)
+    // Short rationale for estimate: lower_bound järjestetystä vektorista ja
+    //                               k annetun ajan jälkeisen lähdön kopiointi
     std::vector<std::pair<Time, TrainID>> station_departures_after(StationID stationid, Time time);
 
     // We recommend you implement the operations below only after implementing the ones above
 
     // Estimate of performance: O(nlogn)
     // Short rationale for estimate: sama toteutusperiaate, kuin add_departure
-    bool add_region(RegionID id, Name const& name, std::vector<Coord> coords);
+    bool add_region(RegionID id, Name const& name, std::vector<Coord> const& coords);
 
     // Estimate of performance: O(1)
     // Short rationale for estimate: palauttaa valmiin vektorin
@@ -190,7 +233,8 @@ public:
 
     // Estimate of performance: O(nlogn)
     // Short rationale for estimate: tarkistaa ensin voiko subregionin lisätä,
-    //                               lisää subregionin sekä parentregionin
+    //                               lisää subregionin sekä parentregionin,
+    //                               siirtyvän alipuun n esivanhempitaulut O(logd)
     bool add_subregion_to_region(RegionID id, RegionID parentid);
 
     // Estimate of performance: O(nlogn)
@@ -203,60 +247,528 @@ public:
     //                               käy läpi kaikki parentregionit, johin aseman regioni kuuluu
     std::vector<RegionID> station_in_regions(StationID id);
 
+    // Estimate of performance: O(r + n)
+    // Short rationale for estimate: alueen r alialuetta ovat peräkkäin region_order:ssa,
+    //                               jokaisen alueen omat asemat luetaan suoraan
+    std::vector<StationID> stations_in_region(RegionID id);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: unordered_map::find, laskurit päivitetään
+    //                               muutosten yhteydessä
+    std::pair<int, int> region_stats(RegionID id);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: unordered_map::find, suorakulmio, pinta-ala ja
+    //                               painopiste lasketaan jo add_region:ssa
+    std::tuple<Coord, Coord, double, Coord> region_geometry(RegionID id);
+
     // Non-compulsory operations----------------------------------
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate: vectoriin lisäys (insert) lineaarinen
-    //
+    // Short rationale for estimate: alialueet ovat peräkkäin region_order:ssa,
+    //                               kopioidaan n alialuetta
     std::vector<RegionID> all_subregions_of_region(RegionID id);
 
-    // Estimate of performance: O(nlogn)
-    // Short rationale for estimate: käy läpi kaikki asemat ja laskee niiden
-    //                               etäisyyden xy:stä map-tietorakenteessa pidetään vain kolmea alkiota
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: kaksi unordered_map::find -hakua ja alipuuvälien
+    //                               vertailu, järjestys rakennetaan tarvittaessa O(r)
+    bool is_subregion_of(RegionID id, RegionID parentid);
+
+    // Estimate of performance: O(logn)
+    // Short rationale for estimate: k-d -puun haku kolmelle lähimmälle asemalle
     std::vector<StationID> stations_closest_to(Coord xy);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: vector::remove + vector::erase + unordered_map:
+    // Estimate of performance: O(logr + k·v)
+    // Short rationale for estimate: R-puu rajaa ehdokkaiksi k aluetta, joiden
+    //                               suorakulmio sisältää pisteen, v kärjen monikulmiotesti
+    std::vector<RegionID> regions_containing(Coord xy);
+
+    // Estimate of performance: O(n(logr + k·v) / p)
+    // Short rationale for estimate: jokaiselle n alueettomalle asemalle R-puuhaku,
+    //                               haut jaetaan p säikeelle, liitokset lopuksi yhdessä säikeessä
+    int assign_stations_to_regions(unsigned int threads = 0);
+
+    // Estimate of performance: O(k·v)
+    // Short rationale for estimate: jokainen käytettävissä oleva ydin (scalar, sse2, avx2)
+    //                               ajetaan k pisteelle kaikkien alueiden v kärkeen,
+    //                               tulokset verrataan skalaariytimeen pisteittäin
+    std::vector<std::tuple<std::string, double, int, int>> polygon_kernel_benchmark(unsigned int points);
+
+    // Estimate of performance: O(logn + k)
+    // Short rationale for estimate: k-d -puun haku, puu pidetään tasapainossa
+    //                               rakentamalla se tarvittaessa uudelleen
+    std::vector<StationID> stations_closest_to(Coord xy, unsigned int k);
+
+    // Estimate of performance: O(logn + d(b + s) + h)
+    // Short rationale for estimate: aseman paikka vec_all_stations:ssa tiedetään, joten
+    //                               poisto vaihtamalla viimeiseen ja pop_back O(1),
+    //                               unordered_map::erase O(1), set::erase O(logN) x2,
+    //                               jokainen aseman d lähdöstä poistetaan minuuttikorista
+    //                               O(korin koko b) ja junan pysähdyksistä O(s),
+    //                               alueen laskurit päivitetään h esivanhempaan, k-d -puun
+    //                               uudelleenrakennus O(nlogn) jakautuu n/2 poistolle
     bool remove_station(StationID id);
 
-    // Estimate of performance: O(nlogn)
-    // Short rationale for estimate: etsii ensin molempien kaikki parentit
-    //                               minkä jälkeen etsii yhteisen
+    // Estimate of performance: O(log d)
+    // Short rationale for estimate: syvempi alue nostetaan samalle syvyydelle ja
+    //                               molempia nostetaan 2^k askelin (binary lifting)
     RegionID common_parent_of_regions(RegionID id1, RegionID id2);
 
-private:
-    // Add stuff needed for your class implementation here
+    // Estimate of performance: O(r + q)
+    // Short rationale for estimate: Tarjanin offline-algoritmi, yksi syvyyshaku
+    //                               r alueen metsään ja union-find q parille
+    std::vector<RegionID> common_parents_of_regions(std::vector<std::pair<RegionID, RegionID>> const& pairs);
+
+    // Estimate of performance: O(k + m)
+    // Short rationale for estimate: käy läpi aikavälin minuuttikorit (enintään 1440)
+    //                               ja järjestää kunkin korin k lähtöä
+    std::vector<std::tuple<Time, StationID, TrainID>> departures_between(Time from, Time to);
+
+    // Estimate of performance: O(k)
+    // Short rationale for estimate: unordered_map::find junan pysähdyksiin O(1),
+    //                               aseman etsiminen ja k pysähdyksen kopiointi
+    std::vector<std::pair<StationID, Time>> train_stations_from(StationID stationid, TrainID trainid);
+
+    // Estimate of performance: O(c + n)
+    // Short rationale for estimate: muuttuneiden junien yhteydet päivitetään ensin,
+    //                               sitten yksi läpikäynti lähtöajan jälkeisistä c yhteydestä
+    std::vector<std::tuple<StationID, TrainID, Time>> route_earliest_arrival(StationID fromid, StationID toid, Time starttime);
+
+    // Estimate of performance: O(c + n)
+    // Short rationale for estimate: yksi yhteyshaku lähtöajasta aikarajaan asti kaikille
+    //                               asemille kerralla, lopuksi saavutetut n asemaa kerätään
+    std::vector<StationID> stations_reachable_within(StationID stationid, Time starttime, int minutes);
+
+    // Estimate of performance: O(s(c + n) / p)
+    // Short rationale for estimate: yksi yhteyshaku jokaisesta s lähtöasemasta,
+    //                               haut jaetaan p säikeelle
+    std::vector<Time> travel_time_matrix(std::vector<StationID> const& stationids, Time starttime, unsigned int threads = 0);
+
+    // Estimate of performance: O((n + e)logn)
+    // Short rationale for estimate: A*-haku kekoa käyttäen, linnuntie-etäisyys
+    //                               määränpäähän rajaa käsiteltävät asemat
+    std::vector<std::tuple<StationID, TrainID, Distance>> route_shortest_distance(StationID fromid, StationID toid);
+
+    // Estimate of performance: O((n + e)logn)
+    // Short rationale for estimate: sama haku ilman heuristiikkaa (Dijkstra),
+    //                               vertailukohta route_shortest_distance:lle
+    std::vector<std::tuple<StationID, TrainID, Distance>> route_shortest_distance_dijkstra(StationID fromid, StationID toid);
+
+    // Estimate of performance: O(n² log n) (rakennus), käytännössä lähes lineaarinen
+    // Short rationale for estimate: asemat supistetaan prioriteettijonon järjestyksessä,
+    //                               jokaiselle rajattu todistajahaku (witness search)
+    bool build_route_hierarchy(bool background = false);
+
+    // Estimate of performance: O(k log k), k << n
+    // Short rationale for estimate: kaksisuuntainen haku vain hierarkiassa ylöspäin,
+    //                               A* O((n + e)logn), jos hierarkia on vanhentunut
+    std::vector<std::tuple<StationID, TrainID, Distance>> route_shortest_distance_hierarchy(StationID fromid, StationID toid);
+
+    // Kopioimattomat operaatiot ---------------------------------
+    // Näkymät osoittavat suoraan sisäisiin taulukoihin, puskuriversiot täyttävät
+    // kutsujan vektorin, jonka kapasiteetti säilyy kutsusta toiseen.
 
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: näkymä vec_all_stations:iin
+    ConstView<StationID> all_stations_view();
 
-    struct StationInfo
-    {
-        StationInfo(Name stationName, Coord stationCoord): stationName(stationName), stationCoord(stationCoord) {}
-        Name stationName;
-        Coord stationCoord;
-        map<Time, set<TrainID>> departures;
-        RegionID region = NO_REGION;
-    };
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: näkymä vec_all_regions:iin
+    ConstView<RegionID> all_regions_view();
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: unordered_map::find ja kärkien purku yhteiseen
+    //                               puskuriin, jonka seuraava kutsu korvaa
+    ConstView<Coord> region_coords_view(RegionID id);
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: vector::assign, ei varausta jos kapasiteetti riittää
+    void all_stations(std::vector<StationID>& out);
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: vector::assign, ei varausta jos kapasiteetti riittää
+    void all_regions(std::vector<RegionID>& out);
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: unordered_map::find ja kärkien purku suoraan out:iin
+    bool get_region_coords(RegionID id, std::vector<Coord>& out);
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: unordered_map::find ja vector::assign
+    bool all_subregions_of_region(RegionID id, std::vector<RegionID>& out);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: unordered_map::find ja näkymä region_order:n väliin,
+    //                               järjestys rakennetaan tarvittaessa O(r)
+    ConstView<RegionID> all_subregions_view(RegionID id);
 
+    // Kahvaa käyttävät operaatiot -------------------------------
+    // StationID-versiot yllä hakevat kahvan kerran ja kutsuvat näitä.
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: unordered_map::find keskimäärin vakio
+    StationHandle station_handle(StationID const& id);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: sarakkeen luku
+    StationID station_id(StationHandle station);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: sarakkeen luku
+    Name get_station_name(StationHandle station);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: sarakkeen luku
+    Coord get_station_coordinates(StationHandle station);
+
+    // Estimate of performance: O(logn)
+    // Short rationale for estimate: indeksien päivitys set::erase + set::insert O(logN),
+    //                               automaattisesti liitetylle asemalle R-puuhaku
+    bool change_station_coord(StationHandle station, Coord newcoord);
+
+    // Estimate of performance: O(logn)
+    // Short rationale for estimate: sama kuin add_departure(StationID, ...)
+    bool add_departure(StationHandle station, TrainID const& trainid, Time time);
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: sama kuin remove_departure(StationID, ...)
+    bool remove_departure(StationHandle station, TrainID const& trainid, Time time);
+
+    // Estimate of performance: O(logn + k)
+    // Short rationale for estimate: sama kuin station_departures_after(StationID, ...)
+    std::vector<std::pair<Time, TrainID>> station_departures_after(StationHandle station, Time time);
+
+    // Estimate of performance: O(k)
+    // Short rationale for estimate: sama kuin train_stations_from(StationID, ...)
+    std::vector<std::pair<StationID, Time>> train_stations_from(StationHandle station, TrainID const& trainid);
+
+    // Estimate of performance: O(c + n)
+    // Short rationale for estimate: sama kuin route_earliest_arrival(StationID, ...)
+    std::vector<std::tuple<StationID, TrainID, Time>> route_earliest_arrival(StationHandle from, StationHandle to, Time starttime);
+
+    // Estimate of performance: O(c + n)
+    // Short rationale for estimate: sama kuin stations_reachable_within(StationID, ...)
+    std::vector<StationID> stations_reachable_within(StationHandle station, Time starttime, int minutes);
+
+    // Estimate of performance: O((n + e)logn)
+    // Short rationale for estimate: sama kuin route_shortest_distance(StationID, ...)
+    std::vector<std::tuple<StationID, TrainID, Distance>> route_shortest_distance(StationHandle from, StationHandle to,
+                                                                                  bool use_heuristic = true);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: sarakkeen luku ja unordered_map::find
+    bool add_station_to_region(StationHandle station, RegionID parentid);
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: käy läpi aseman alueen kaikki parentit
+    std::vector<RegionID> station_in_regions(StationHandle station);
+
+    // Estimate of performance: O(logn + d(b + s) + h)
+    // Short rationale for estimate: sama kuin remove_station(StationID)
+    bool remove_station(StationHandle station);
+
+private:
+    // Add stuff needed for your class implementation here
+
+    // Kaikki alla olevat säiliöt varaavat muistinsa tästä poolista, jolloin pienet
+    // solmut (map, set, unordered_map) eivät kukin erikseen kutsu new/delete:ä.
+    // clear_all palauttaa poolin muistin kerralla. Poolin on oltava ensimmäinen
+    // jäsen, jotta se tuhotaan vasta säiliöiden jälkeen.
+    pmr::unsynchronized_pool_resource pool;
+
+    // ancestors[k] on alueen 2^k:s esivanhempi (binary lifting), taulukko
+    // päivitetään add_subregion_to_region:ssa koko siirtyvälle alipuulle.
+    // Alueella on vain suorat alialueensa ja suoraan siihen lisätyt asemat,
+    // kaikki alialueet ovat region_order:ssa välillä (subtreeBegin, subtreeEnd).
+    // stationCount ja departureCount sisältävät myös alialueiden asemat ja
+    // lähdöt, ja ne päivitetään koko esivanhempiketjuun muutosten yhteydessä.
     struct RegionInfo
     {
-        RegionInfo(Name regionName, vector<Coord> regionCoords): regionName(regionName), regionCoords(regionCoords) {}
+        RegionInfo(RegionID regionId, Name const& regionName, pmr::memory_resource* pool):
+            regionId(regionId), regionName(regionName),
+            childRegions(pool), regionStations(pool), ancestors(pool) {}
+        RegionID regionId;
         Name regionName;
-        vector<Coord> regionCoords;
-        unordered_set<RegionID> subRegions;
+        pmr::vector<RegionInfo*> childRegions;
+        pmr::vector<StationHandle> regionStations;
         RegionID parentRegion = NO_REGION;
+        unsigned int depth = 0;
+        pmr::vector<RegionInfo*> ancestors;
+        size_t subtreeBegin = 0;
+        size_t subtreeEnd = 0;
+        int stationCount = 0;
+        int departureCount = 0;
+        // rajojen ympäröivä suorakulmio, etumerkillinen kaksinkertainen pinta-ala
+        // (positiivinen vastapäivään kierretylle) ja painopiste
+        Coord boundsLow;
+        Coord boundsHigh;
+        long long int doubleArea = 0;
+        Coord centroid;
+        // kärkien koodattu esitys polygon_bytes:ssa alkaen verticesBegin:stä
+        std::size_t verticesBegin = 0;
+        std::uint32_t vertexCount = 0;
+        // kärkien paikka polygon_x/polygon_y -välimuistissa, ensimmäinen kärki
+        // toistetaan lopussa, joten reunat ovat (i, i + 1) välillä [begin, end - 1)
+        std::uint32_t polygonBegin = 0;
+        std::uint32_t polygonEnd = 0;
     };
 
 
-    unordered_map<StationID, shared_ptr<StationInfo>> stations;
-    vector<StationID> vec_all_stations;
-
-    unordered_map<RegionID, shared_ptr<RegionInfo>> regions;
-    vector<RegionID> vec_all_regions;
+    // Asemien tiedot tallennetaan sarakkeittain: jokaisella asemalla on paikka,
+    // joka on sen indeksi kaikissa station_-alkuisissa vektoreissa. Poistetun
+    // aseman paikka otetaan uudelleen käyttöön, joten sarakkeet pysyvät
+    // tiiviinä ja koordinaatteja voi käydä läpi peräkkäin muistissa.
+    // stations-taulussa ja sisäisissä rakenteissa on paikka ilman sukupolvea.
+    pmr::unordered_map<StationID, StationHandle> stations;
+    pmr::vector<StationID> vec_all_stations;
+
+    pmr::vector<Coord> station_coords;
+    pmr::vector<Name> station_names;
+    pmr::vector<RegionID> station_regions;
+    // aseman paikka alueensa regionStations-vektorissa
+    pmr::vector<size_t> station_region_slots;
+    // true, jos assign_stations_to_regions liitti aseman alueeseen, jolloin
+    // change_station_coord siirtää sen uuden sijainnin pienimpään alueeseen.
+    // Lippu säilyy, vaikka asema siirtyisi kaikkien alueiden ulkopuolelle,
+    // mutta add_station_to_region poistaa sen.
+    pmr::vector<bool> station_auto_regions;
+    // aseman lähdöt (aika, juna) -järjestyksessä yhtenäisessä vektorissa, uudet
+    // lähdöt kerätään ensin järjestämättömään station_pending_departures -puskuriin,
+    // joka lomitetaan järjestettyyn osaan kun se täyttyy tai lähtöjä haetaan
+    using Departure = pair<Time, TrainID>;
+    pmr::vector<pmr::vector<Departure>> station_departures;
+    pmr::vector<pmr::vector<Departure>> station_pending_departures;
+    static constexpr size_t DEPARTURE_BATCH = 64;
+
+    // koko verkon lähdöt minuuteittain: korissa i ovat lähdöt, joiden aika on
+    // i minuuttia keskiyön jälkeen (HHMM-aika 0000-2359 -> 0-1439)
+    static constexpr unsigned int MINUTES_PER_DAY = 24*60;
+    pmr::vector<pmr::vector<pair<StationHandle, TrainID>>> departure_buckets;
+
+    // junien vuorot: junan pysähdykset (aika, asema) lähtöajan mukaan järjestyksessä,
+    // päivitetään lähtöjen lisäyksen ja poiston yhteydessä
+    using TrainStop = pair<Time, StationHandle>;
+    pmr::unordered_map<TrainID, pmr::vector<TrainStop>> train_stops;
+
+    // reittihaun yhteydet: jokaisesta junan kahden peräkkäisen pysähdyksen välistä
+    // tulee yksi yhteys, ja yhteydet ovat lähtöajan mukaan järjestyksessä.
+    // Keskiyön yli menevän yhteyden saapumisaika on pienempi kuin lähtöaika. HHMM-ajat
+    // järjestyvät samoin kuin minuutit, joten niitä voi vertailla sellaisenaan.
+    // Junat numeroidaan (trip), jotta yhteys on pieni ja kopioitava rakenne.
+    struct Connection
+    {
+        Time departure;
+        Time arrival;
+        StationHandle from;
+        StationHandle to;
+        std::uint32_t trip;
+    };
+    pmr::vector<Connection> connections;
+    pmr::unordered_map<TrainID, std::uint32_t> trip_numbers;
+    pmr::vector<TrainID> trip_ids;
+    pmr::vector<std::uint32_t> free_trips;
+    // junat, joiden pysähdykset ovat muuttuneet yhteyksien päivityksen jälkeen
+    pmr::unordered_set<TrainID> dirty_trains;
+    static constexpr std::uint32_t NO_TRIP = std::numeric_limits<std::uint32_t>::max();
+
+    // etäisyysreitityksen verkko CSR-muodossa: aseman kahvan naapurit ovat
+    // graph_edges[graph_offsets[h]] ... graph_edges[graph_offsets[h+1]-1].
+    // Kahden aseman välillä on yksi kaari, vaikka niiden väliä ajaisi monta junaa.
+    // Verkko rakennetaan yhteyksistä uudelleen, kun pysähdykset tai pysähdysasemien koordinaatit muuttuvat.
+    struct GraphEdge
+    {
+        StationHandle to;
+        std::uint32_t trip;
+        double length;
+    };
+    pmr::vector<size_t> graph_offsets;
+    pmr::vector<GraphEdge> graph_edges;
+    pmr::vector<bool> graph_has_incoming;
+    bool graph_dirty = true;
+    // kasvaa aina kun verkko rakennetaan uudelleen, hierarkia on ajan tasalla
+    // kun sen versio on sama
+    unsigned long int graph_version = 0;
+
+    // reittihierarkia (contraction hierarchy): asemat supistetaan yksi kerrallaan,
+    // ja supistetun aseman kautta kulkevat lyhimmät polut korvataan oikopoluilla.
+    // Haku etenee molemmista päistä vain kohti myöhemmin supistettuja asemia.
+    // Hierarkia käyttää tavallisia vektoreita, koska se voidaan rakentaa
+    // taustasäikeessä eikä poolia saa käyttää kahdesta säikeestä.
+    static constexpr std::uint32_t NO_EDGE = std::numeric_limits<std::uint32_t>::max();
+    struct HierarchyEdge
+    {
+        StationHandle from;
+        StationHandle to;
+        double length;
+        std::uint32_t trip;
+        // oikopolun osat (kaari-indeksejä), NO_EDGE alkuperäisellä kaarella
+        std::uint32_t first;
+        std::uint32_t second;
+    };
+    struct RouteHierarchy
+    {
+        unsigned long int version = 0;
+        std::vector<std::uint32_t> rank;
+        std::vector<HierarchyEdge> edges;
+        // ylöspäin menevät kaaret lähtöaseman mukaan, alaspäin tulevat kohteen mukaan
+        std::vector<size_t> up_offsets;
+        std::vector<std::uint32_t> up;
+        std::vector<size_t> down_offsets;
+        std::vector<std::uint32_t> down;
+        // hakujen työtilat, palautetaan jokaisen haun jälkeen
+        std::vector<double> forward_distance;
+        std::vector<double> backward_distance;
+        std::vector<std::uint32_t> forward_edge;
+        std::vector<std::uint32_t> backward_edge;
+        std::vector<StationHandle> touched;
+    };
+    struct GraphSnapshot
+    {
+        unsigned long int version;
+        std::vector<size_t> offsets;
+        std::vector<GraphEdge> edges;
+    };
+    RouteHierarchy hierarchy;
+    std::future<RouteHierarchy> hierarchy_future;
+    bool hierarchy_background = false;
+    pmr::vector<StationID> station_ids;
+    // aseman paikka vec_all_stations -vektorissa, NO_INDEX jos kahva on vapaa
+    pmr::vector<size_t> station_index;
+    // aseman solmu k-d -puussa
+    pmr::vector<int> station_kd_nodes;
+    pmr::vector<StationHandle> free_handles;
+    // Sisäisesti asemaa käsitellään paikkana (kahvan alimmat HANDLE_INDEX_BITS
+    // bittiä), ulos annettavassa kahvassa on lisäksi paikan sukupolvi, joka
+    // kasvaa aina kun paikan asema poistetaan. Sukupolvet eivät ole poolissa,
+    // koska ne säilyvät clear_all:n yli, jotta vanhat kahvat pysyvät virheellisinä.
+    // Paikka, jonka sukupolvi saavuttaa RETIRED_GENERATION:n, jätetään käyttämättä,
+    // jottei sukupolvi pyörähdä ympäri ja vanha kahva kelpaa uudelleen.
+    static constexpr unsigned int HANDLE_INDEX_BITS = 24;
+    static constexpr StationHandle HANDLE_INDEX_MASK = (StationHandle(1) << HANDLE_INDEX_BITS) - 1;
+    static constexpr std::uint8_t RETIRED_GENERATION = std::numeric_limits<std::uint8_t>::max();
+    std::vector<std::uint8_t> station_generations;
+    static constexpr size_t NO_INDEX = std::numeric_limits<size_t>::max();
+
+    // asemat nimen mukaan järjestyksessä, id ratkaisee samannimiset
+    pmr::set<pair<Name, StationID>> stations_by_name;
+
+    // asemat etäisyyden mukaan origosta: (x²+y², y, id), kokonaislukuavaimet
+    // joten vertailu on tarkka eikä liukulukuja tarvita
+    using DistanceKey = tuple<long long int, int, StationID>;
+    pmr::set<DistanceKey> stations_by_distance;
+
+    // asemat koordinaatin mukaan, samassa pisteessä voi olla useampi asema
+    pmr::unordered_multimap<Coord, StationHandle, CoordHash> stations_by_coord;
+
+    // k-d -puu asemien koordinaateista, tasot vuorottelevat x- ja y-akselin välillä.
+    // Poistetut solmut vain merkitään, ja puu rakennetaan uudelleen kun poistettuja
+    // on yhtä paljon kuin eläviä tai puu on kasvanut liian syväksi.
+    struct KdNode
+    {
+        Coord xy;
+        StationHandle station;
+        int left = -1;
+        int right = -1;
+        bool removed = false;
+    };
+    pmr::vector<KdNode> kd_nodes;
+    int kd_root = -1;
+    size_t kd_removed = 0;
+
+    pmr::unordered_map<RegionID, shared_ptr<RegionInfo>> regions;
+    pmr::vector<RegionID> vec_all_regions;
+
+    // R-puu alueiden suorakulmioista, pakataan Sort-Tile-Recursive -menetelmällä.
+    // Alueita vain lisätään, joten puu rakennetaan kokonaan uudelleen ensimmäisessä
+    // kyselyssä lisäysten jälkeen. Lehtisolmun lapset ovat rtree_regions:ssa,
+    // muiden solmujen lapset rtree_nodes:ssa, ja juuri on viimeisenä.
+    struct RTreeNode
+    {
+        Coord low;
+        Coord high;
+        std::uint32_t first;
+        std::uint32_t count;
+        bool leaf;
+    };
+    static constexpr size_t RTREE_FANOUT = 16;
+    pmr::vector<RTreeNode> rtree_nodes;
+    pmr::vector<RegionInfo*> rtree_regions;
+    bool rtree_dirty = false;
+
+    // Alueiden rajat tallennetaan kerran polygon_bytes:iin: ensimmäinen kärki
+    // sellaisenaan ja muut erotuksena edelliseen, kukin luku zigzag-koodattuna
+    // varinttina (7 bittiä tavua kohden). Tiheästi pisteytetyssä rajassa
+    // erotukset ovat pieniä, joten kärki vie tyypillisesti 2-4 tavua.
+    pmr::vector<std::uint8_t> polygon_bytes;
+    // Monikulmiotestiä varten kärjet puretaan erillisiksi x- ja y-taulukoiksi
+    // (SoA), jotta useamman reunan y:t voi vertailla kerralla SIMD-käskyin.
+    // Välimuisti täytetään vasta ensimmäisessä sijaintikyselyssä, ja siihen
+    // puretaan vain vec_all_regions:n alueet polygon_cached_regions:sta eteenpäin.
+    pmr::vector<int> polygon_x;
+    pmr::vector<int> polygon_y;
+    std::size_t polygon_cached_regions = 0;
+    // region_coords_view:n purkupuskuri, region_coords_epoch kasvaa aina kun
+    // puskuri korvataan, jolloin aiemmat näkymät vanhenevat
+    pmr::vector<Coord> region_coords_buffer;
+    unsigned long int region_coords_epoch = 0;
+    // alueet metsän syvyyshaun esijärjestyksessä, rakennetaan uudelleen
+    // ensimmäisessä kyselyssä alueiden tai alialueiden lisäämisen jälkeen
+    pmr::vector<RegionID> region_order;
+    bool region_order_dirty = false;
+
+    // kasvaa aina kun asemia tai alueita lisätään tai poistetaan tai alueiden
+    // hierarkia muuttuu, ConstView
+    // vertaa tätä luontihetken arvoon
+    unsigned long int epoch = 0;
 
-    bool stationExists(StationID id);
     bool regionExists(RegionID id);
-
-    int calc_distance(Coord xy, StationID id);
+    static void update_ancestors(RegionInfo& region, RegionInfo* parent);
+    static RegionInfo* lift_region(RegionInfo* region, unsigned int depth);
+    void update_region_order();
+    void add_region_totals(RegionID id, int stations, int departures);
+    void update_rtree();
+    void update_polygon_cache();
+    template <typename Emit>
+    void decode_polygon(RegionInfo const& region, Emit emit) const;
+    void rtree_regions_containing(Coord xy, vector<RegionInfo*>& out) const;
+    RegionInfo* smallest_region_containing(Coord xy) const;
+    bool polygon_contains(RegionInfo const& region, Coord xy) const;
+    void attach_station_to_region(StationHandle station, RegionID parentid, bool automatic);
+    void detach_station_from_region(StationHandle station);
+
+    StationHandle find_station(StationID const& id);
+    bool valid_station(StationHandle handle);
+    StationHandle make_handle(StationHandle station);
+    static StationHandle handle_slot(StationHandle handle);
+
+    static int minute_of_day(Time time);
+    void erase_from_bucket(StationHandle station, Departure const& departure);
+    void add_train_stop(TrainID const& trainid, TrainStop stop);
+    void erase_train_stop(TrainID const& trainid, TrainStop stop);
+    static size_t trip_start(pmr::vector<TrainStop> const& stops);
+    void update_connections();
+    void scan_arrivals(StationHandle from, Time starttime, Time deadline,
+                       std::vector<Time>& arrival, std::vector<bool>& boarded) const;
+    void update_graph();
+    double calc_distance(StationHandle a, StationHandle b);
+    GraphSnapshot graph_snapshot();
+    static RouteHierarchy build_hierarchy(GraphSnapshot const& graph);
+    bool update_hierarchy(bool rebuild);
+    std::vector<std::tuple<StationID, TrainID, Distance>> hierarchy_route(StationHandle from, StationHandle to);
+    void merge_departures(StationHandle station);
+    bool has_departure(StationHandle station, Departure const& departure);
+
+    static DistanceKey distance_key(Coord xy, StationID const& id);
+    void erase_coord_index(Coord xy, StationHandle station);
+
+    void kd_insert(StationHandle station, Coord xy);
+    void kd_remove(StationHandle station);
+    void kd_rebuild();
+    int kd_build(vector<int>& nodes, size_t begin, size_t end, int depth);
+    bool kd_closer(pair<long long int, StationHandle> const& a,
+                   pair<long long int, StationHandle> const& b);
+    void kd_search(int node, int depth, Coord xy, size_t k,
+                   vector<pair<long long int, StationHandle>>& best);
 
 
 };
@@ -163,6 +163,35 @@ void MainProgram::test_station_info()
     }
 }
 
+MainProgram::CmdResult MainProgram::cmd_save_station_handle(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    StationID id = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    StationHandle handle = ds_.station_handle(id);
+    if (handle == NO_STATION_HANDLE)
+    {
+        return {ResultType::IDLIST, CmdResultIDs{{}, {NO_STATION}}};
+    }
+    saved_handles_[id] = handle;
+    output << "Handle of " << id << " saved." << endl;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_station_of_saved_handle(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    StationID id = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto saved = saved_handles_.find(id);
+    if (saved == saved_handles_.end())
+    {
+        output << "No handle saved for " << id << "!" << endl;
+        return {};
+    }
+    return {ResultType::IDLIST, CmdResultIDs{{}, {ds_.station_id(saved->second)}}};
+}
+
 MainProgram::CmdResult MainProgram::cmd_change_station_coord(std::ostream& /*output*/, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     StationID id = *begin++;
@@ -295,6 +324,274 @@ void MainProgram::test_station_departures_after()
     }
 }
 
+MainProgram::CmdResult MainProgram::cmd_departures_between(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    Time from = convert_string_to<Time>(*begin++);
+    Time to = convert_string_to<Time>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto departures = ds_.departures_between(from, to);
+
+    if (!departures.empty())
+    {
+        output << "Departures between " << setw(4) << setfill('0') << from << " and " << setw(4) << setfill('0') << to << ":" << endl;
+        for (auto& [deptime, stationid, trainid] : departures)
+        {
+            output << " " << trainid << " from ";
+            print_station_brief(stationid, output, false);
+            output << " at " << setw(4) << setfill('0') << deptime << endl;
+        }
+    }
+    else
+    {
+        output << "No departures between " << setw(4) << setfill('0') << from << " and " << setw(4) << setfill('0') << to << endl;
+    }
+
+    return {};
+}
+
+void MainProgram::test_departures_between()
+{
+    auto from = 100*random(0,23) + random(0,59);
+    auto to = std::min(from + 15, 2359);
+    ds_.departures_between(from, to);
+}
+
+MainProgram::CmdResult MainProgram::cmd_train_stations_from(std::ostream &/*output*/, MatchIter begin, MatchIter end)
+{
+    StationID stationid = *begin++;
+    TrainID trainid = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto stops = ds_.train_stations_from(stationid, trainid);
+
+    CmdResultTrains result;
+    for (auto& [stopid, time] : stops)
+    {
+        result.emplace_back(trainid, stopid, NO_STATION, time);
+    }
+
+    return {ResultType::TRAINS, result};
+}
+
+void MainProgram::test_train_stations_from()
+{
+    if (random_stations_added_ > 0) // Don't do anything if there's no stations
+    {
+        auto stationid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto trainid = n_to_trainid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        ds_.train_stations_from(stationid, trainid);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_route_earliest_arrival(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    StationID fromid = *begin++;
+    StationID toid = *begin++;
+    Time time = convert_string_to<Time>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto route = ds_.route_earliest_arrival(fromid, toid, time);
+
+    if (route.empty())
+    {
+        output << "No route found." << endl;
+        return {};
+    }
+
+    CmdResultRoute result;
+    if (route.size() == 1 && get<0>(route.front()) == NO_STATION)
+    {
+        result.emplace_back(NO_TRAIN, NO_STATION, NO_STATION, NO_TIME, NO_DISTANCE);
+        return {ResultType::ROUTE, result};
+    }
+
+    for (auto it = route.begin(); it != route.end(); ++it)
+    {
+        auto [stationid, trainid, deptime] = *it;
+        auto next = std::next(it);
+        StationID nextid = (next != route.end()) ? get<0>(*next) : NO_STATION;
+        result.emplace_back(trainid, stationid, nextid, deptime, NO_DISTANCE);
+    }
+
+    return {ResultType::ROUTE, result};
+}
+
+void MainProgram::test_route_earliest_arrival()
+{
+    if (random_stations_added_ > 0) // Don't do anything if there's no stations
+    {
+        auto fromid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto toid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto time = 100*random(0,23) + random(0,59);
+        ds_.route_earliest_arrival(fromid, toid, time);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_stations_reachable_within(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    StationID stationid = *begin++;
+    Time time = convert_string_to<Time>(*begin++);
+    int minutes = convert_string_to<int>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto stations = ds_.stations_reachable_within(stationid, time, minutes);
+    if (stations.empty())
+    {
+        output << "No stations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, stations}};
+}
+
+void MainProgram::test_stations_reachable_within()
+{
+    if (random_stations_added_ > 0) // Don't do anything if there's no stations
+    {
+        auto stationid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto time = 100*random(0,23) + random(0,59);
+        ds_.stations_reachable_within(stationid, time, random(0, 240));
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_travel_time_matrix(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    Time time = convert_string_to<Time>(*begin++);
+    string threadsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int threads = threadsstr.empty() ? 0 : convert_string_to<unsigned int>(threadsstr);
+    auto stations = ds_.all_stations();
+    std::sort(stations.begin(), stations.end());
+
+    auto start = std::chrono::steady_clock::now();
+    auto matrix = ds_.travel_time_matrix(stations, time, threads);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (matrix.size() == 1 && matrix.front() == NO_TIME)
+    {
+        output << "Failed (NO_TIME returned)!" << endl;
+        return {};
+    }
+
+    unsigned int reachable = std::count_if(matrix.begin(), matrix.end(), [](Time t){ return t != NO_TIME; });
+    output << "Travel time matrix of " << stations.size() << " stations from " << setw(4) << setfill('0') << time
+           << ": " << reachable << " reachable pairs, " << elapsed << " sec" << endl;
+    for (unsigned int row = 0; row < stations.size(); ++row)
+    {
+        output << stations[row] << ":";
+        for (unsigned int column = 0; column < stations.size(); ++column)
+        {
+            Time arrival = matrix[row * stations.size() + column];
+            if (arrival == NO_TIME) { output << " ----"; }
+            else { output << " " << setw(4) << setfill('0') << arrival; }
+        }
+        output << endl;
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::route_distance_result(std::vector<std::tuple<StationID, TrainID, Distance>> const& route, std::ostream& output)
+{
+    if (route.empty())
+    {
+        output << "No route found." << endl;
+        return {};
+    }
+
+    CmdResultRoute result;
+    if (route.size() == 1 && get<0>(route.front()) == NO_STATION)
+    {
+        result.emplace_back(NO_TRAIN, NO_STATION, NO_STATION, NO_TIME, NO_DISTANCE);
+        return {ResultType::ROUTE, result};
+    }
+
+    for (auto it = route.begin(); it != route.end(); ++it)
+    {
+        auto [stationid, trainid, dist] = *it;
+        auto next = std::next(it);
+        StationID nextid = (next != route.end()) ? get<0>(*next) : NO_STATION;
+        result.emplace_back(trainid, stationid, nextid, NO_TIME, dist);
+    }
+
+    return {ResultType::ROUTE, result};
+}
+
+MainProgram::CmdResult MainProgram::cmd_route_shortest_distance(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    StationID fromid = *begin++;
+    StationID toid = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    return route_distance_result(ds_.route_shortest_distance(fromid, toid), output);
+}
+
+void MainProgram::test_route_shortest_distance()
+{
+    if (random_stations_added_ > 0) // Don't do anything if there's no stations
+    {
+        auto fromid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto toid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        ds_.route_shortest_distance(fromid, toid);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_route_shortest_distance_dijkstra(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    StationID fromid = *begin++;
+    StationID toid = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    return route_distance_result(ds_.route_shortest_distance_dijkstra(fromid, toid), output);
+}
+
+void MainProgram::test_route_shortest_distance_dijkstra()
+{
+    if (random_stations_added_ > 0) // Don't do anything if there's no stations
+    {
+        auto fromid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto toid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        ds_.route_shortest_distance_dijkstra(fromid, toid);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_build_route_hierarchy(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string background = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    if (ds_.build_route_hierarchy(!background.empty()))
+    {
+        output << "Route hierarchy is ready." << endl;
+    }
+    else
+    {
+        output << "Route hierarchy is being built in the background." << endl;
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_route_shortest_distance_hierarchy(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    StationID fromid = *begin++;
+    StationID toid = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    return route_distance_result(ds_.route_shortest_distance_hierarchy(fromid, toid), output);
+}
+
+void MainProgram::test_route_shortest_distance_hierarchy()
+{
+    if (random_stations_added_ > 0) // Don't do anything if there's no stations
+    {
+        auto fromid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto toid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        ds_.route_shortest_distance_hierarchy(fromid, toid);
+    }
+}
+
 void MainProgram::test_change_station_coord()
 {
     if (random_stations_added_ > 0) // Don't do anything if there's no stations
@@ -380,6 +677,62 @@ MainProgram::CmdResult MainProgram::cmd_stations_closest_to(std::ostream &output
     return {ResultType::IDLIST, CmdResultIDs{{}, stations}};
 }
 
+MainProgram::CmdResult MainProgram::cmd_regions_containing(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string xstr = *begin++;
+    string ystr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    int x = convert_string_to<int>(xstr);
+    int y = convert_string_to<int>(ystr);
+
+    auto regions = ds_.regions_containing({x,y});
+    if (regions.empty())
+    {
+        output << "No regions!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{regions, {}}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_assign_stations_to_regions(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string threadsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int threads = threadsstr.empty() ? 0 : convert_string_to<unsigned int>(threadsstr);
+    auto assigned = ds_.assign_stations_to_regions(threads);
+    output << assigned << " stations assigned to regions." << endl;
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_polygon_kernel_benchmark(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string pointsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int points = pointsstr.empty() ? 1000 : convert_string_to<unsigned int>(pointsstr);
+    auto results = ds_.polygon_kernel_benchmark(points);
+    double scalar = std::get<1>(results.front());
+
+    output << "  kernel ,   time (sec) ,  speedup , inside , mismatches" << endl;
+    for (auto& [name, time, inside, mismatches] : results)
+    {
+        output << setw(8) << setfill(' ') << name << " , " << setw(12) << time << " , "
+               << setw(8) << (time > 0 ? scalar / time : 0) << " , " << inside << " , " << mismatches << endl;
+    }
+    for (auto& [name, time, inside, mismatches] : results)
+    {
+        if (mismatches != 0)
+        {
+            output << "Kernel " << name << " disagrees with scalar on " << mismatches << " points!" << endl;
+        }
+    }
+
+    return {};
+}
+
 MainProgram::CmdResult MainProgram::cmd_common_parent_of_regions(std::ostream &output, MatchIter begin, MatchIter end)
 {
     RegionID regionid1 = convert_string_to<RegionID>(*begin++);
@@ -396,6 +749,39 @@ MainProgram::CmdResult MainProgram::cmd_common_parent_of_regions(std::ostream &o
     return {ResultType::IDLIST, CmdResultIDs{{regionid1, regionid2, regionid}, {}}};
 }
 
+MainProgram::CmdResult MainProgram::cmd_common_parents_of_regions(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string idsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    std::vector<std::pair<RegionID, RegionID>> pairs;
+    std::istringstream idsstream(idsstr);
+    RegionID regionid1 = NO_REGION;
+    RegionID regionid2 = NO_REGION;
+    while (idsstream >> regionid1 >> regionid2)
+    {
+        pairs.emplace_back(regionid1, regionid2);
+    }
+
+    auto result = ds_.common_parents_of_regions(pairs);
+    std::vector<RegionID> regions;
+    for (unsigned int i = 0; i < pairs.size(); ++i)
+    {
+        output << pairs[i].first << " " << pairs[i].second << ": ";
+        if (result[i] == NO_REGION)
+        {
+            output << "No common parent region found." << endl;
+        }
+        else
+        {
+            output << result[i] << endl;
+            regions.push_back(result[i]);
+        }
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{regions, {}}};
+}
+
 MainProgram::CmdResult MainProgram::cmd_station_in_regions(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     StationID id = *begin++;
@@ -406,6 +792,52 @@ MainProgram::CmdResult MainProgram::cmd_station_in_regions(std::ostream& output,
     return {ResultType::IDLIST, CmdResultIDs{result, {id}}};
 }
 
+MainProgram::CmdResult MainProgram::cmd_stations_in_region(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    RegionID id = convert_string_to<RegionID>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto result = ds_.stations_in_region(id);
+    if (result.empty()) { output << "No stations in region." << std::endl; }
+    std::sort(result.begin(), result.end());
+    return {ResultType::IDLIST, CmdResultIDs{{id}, result}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_region_stats(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    RegionID id = convert_string_to<RegionID>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto [stations, departures] = ds_.region_stats(id);
+    if (stations == NO_VALUE)
+    {
+        output << "Failed (NO_VALUE returned)!" << std::endl;
+        return {};
+    }
+    output << "Region " << id << ": " << stations << " stations, " << departures << " departures" << std::endl;
+    return {ResultType::IDLIST, CmdResultIDs{{id}, {}}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_region_geometry(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    RegionID id = convert_string_to<RegionID>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto [low, high, area, centroid] = ds_.region_geometry(id);
+    if (low == NO_COORD)
+    {
+        output << "Failed (NO_COORD returned)!" << std::endl;
+        return {};
+    }
+    output << "Region " << id << ": bounds ";
+    print_coord(low, output, false);
+    output << " - ";
+    print_coord(high, output, false);
+    output << ", area " << area << ", centroid ";
+    print_coord(centroid, output);
+    return {ResultType::IDLIST, CmdResultIDs{{id}, {}}};
+}
+
 void MainProgram::test_station_in_regions()
 {
     if (random_stations_added_ > 0) // Don't do anything if there's no stations
@@ -415,6 +847,33 @@ void MainProgram::test_station_in_regions()
     }
 }
 
+void MainProgram::test_stations_in_region()
+{
+    if (random_regions_added_ > 0) // Don't do anything if there's no regions
+    {
+        auto id = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+        ds_.stations_in_region(id);
+    }
+}
+
+void MainProgram::test_region_stats()
+{
+    if (random_regions_added_ > 0) // Don't do anything if there's no regions
+    {
+        auto id = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+        ds_.region_stats(id);
+    }
+}
+
+void MainProgram::test_region_geometry()
+{
+    if (random_regions_added_ > 0) // Don't do anything if there's no regions
+    {
+        auto id = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+        ds_.region_geometry(id);
+    }
+}
+
 void MainProgram::test_all_subregions_of_region()
 {
     if (random_regions_added_ > 0) // Don't do anything if there's no regions
@@ -424,6 +883,16 @@ void MainProgram::test_all_subregions_of_region()
     }
 }
 
+void MainProgram::test_is_subregion_of()
+{
+    if (random_regions_added_ > 0) // Don't do anything if there's no regions
+    {
+        auto id1 = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+        auto id2 = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+        ds_.is_subregion_of(id1, id2);
+    }
+}
+
 MainProgram::CmdResult MainProgram::cmd_remove_station(ostream& output, MatchIter begin, MatchIter end)
 {
     string id = *begin++;
@@ -495,6 +964,51 @@ void MainProgram::add_random_stations_regions(unsigned int size, Coord min, Coor
     }
 }
 
+void MainProgram::add_random_trains(unsigned int size)
+{
+    if (random_stations_added_ < 2) { return; } // A train needs at least two stations
+
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        TrainID trainid = n_to_trainid(random_trains_added_);
+        StationID stationid = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        Time time = 100*random(0,20) + random(0,60);
+
+        // The train continues to one of the stations nearest to the previous one
+        auto stops = random(3, 11);
+        for (int stop = 0; stop < stops; ++stop)
+        {
+            Coord xy = ds_.get_station_coordinates(stationid);
+            if (xy == NO_COORD || !ds_.add_departure(stationid, trainid, time)) { break; }
+
+            auto nearest = ds_.stations_closest_to(xy, 5);
+            nearest.erase(std::remove(nearest.begin(), nearest.end(), stationid), nearest.end());
+            if (nearest.empty()) { break; }
+            stationid = nearest[random<decltype(nearest.size())>(0, nearest.size())];
+
+            time += random(1, 10);
+            if (time % 100 >= 60) { time += 40; }
+        }
+
+        ++random_trains_added_;
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_random_trains(ostream& output, MatchIter begin, MatchIter end)
+{
+    string sizestr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int size = convert_string_to<unsigned int>(sizestr);
+    add_random_trains(size);
+
+    output << "Added: " << size << " trains." << endl;
+
+    view_dirty = true;
+
+    return {};
+}
+
 MainProgram::CmdResult MainProgram::cmd_random_stations(ostream& output, MatchIter begin, MatchIter end)
 {
     string sizestr = *begin++;
@@ -638,6 +1152,24 @@ MainProgram::CmdResult MainProgram::cmd_all_subregions_of_region(std::ostream &o
     return {ResultType::IDLIST, CmdResultIDs{regions, {}}};
 }
 
+MainProgram::CmdResult MainProgram::cmd_is_subregion_of(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    RegionID regionid = convert_string_to<RegionID>(*begin++);
+    RegionID parentid = convert_string_to<RegionID>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    if (ds_.is_subregion_of(regionid, parentid))
+    {
+        output << "Region " << regionid << " is a subregion of " << parentid << endl;
+    }
+    else
+    {
+        output << "Region " << regionid << " is not a subregion of " << parentid << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{regionid, parentid}, {}}};
+}
+
 Distance MainProgram::calc_distance(Coord c1, Coord c2)
 {
     if (c1 == NO_COORD || c2 == NO_COORD) { return NO_DISTANCE; }
@@ -823,6 +1355,13 @@ void MainProgram::test_stations_closest_to()
     ds_.stations_closest_to({x,y});
 }
 
+void MainProgram::test_regions_containing()
+{
+    int x = random<int>(1, 10000);
+    int y = random<int>(1, 10000);
+    ds_.regions_containing({x,y});
+}
+
 void MainProgram::test_common_parent_of_regions()
 {
     if (random_regions_added_ > 0) // Don't do anything if there's no regions
@@ -833,6 +1372,21 @@ void MainProgram::test_common_parent_of_regions()
     }
 }
 
+void MainProgram::test_common_parents_of_regions()
+{
+    if (random_regions_added_ > 0) // Don't do anything if there's no regions
+    {
+        std::vector<std::pair<RegionID, RegionID>> pairs;
+        for (unsigned int i = 0; i < 100; ++i)
+        {
+            auto id1 = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+            auto id2 = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+            pairs.emplace_back(id1, id2);
+        }
+        ds_.common_parents_of_regions(pairs);
+    }
+}
+
 MainProgram::CmdResult MainProgram::cmd_randseed(std::ostream& output, MatchIter begin, MatchIter end)
 {
     string seedstr = *begin++;
@@ -1123,6 +1677,8 @@ vector<MainProgram::CmdInfo> MainProgram::cmds_ =
     {"all_stations", "", "", &MainProgram::cmd_all_stations, &MainProgram::test_all_stations },
     {"add_station", "StationID \"Name\" (x,y)", stationidx+wsx+'"'+namex+'"'+wsx+coordx, &MainProgram::cmd_add_station, nullptr },
     {"station_info", "StationID", stationidx, &MainProgram::cmd_station_info, &MainProgram::test_station_info },
+    {"save_station_handle", "StationID", stationidx, &MainProgram::cmd_save_station_handle, nullptr },
+    {"station_of_saved_handle", "StationID", stationidx, &MainProgram::cmd_station_of_saved_handle, nullptr },
     {"stations_alphabetically", "", "", &MainProgram::NoParListCmd<&Datastructures::stations_alphabetically>, &MainProgram::NoParListTestCmd<&Datastructures::stations_alphabetically> },
     {"stations_distance_increasing", "", "", &MainProgram::NoParListCmd<&Datastructures::stations_distance_increasing>,
                                              &MainProgram::NoParListTestCmd<&Datastructures::stations_distance_increasing> },
@@ -1131,6 +1687,15 @@ vector<MainProgram::CmdInfo> MainProgram::cmds_ =
     {"add_departure", "StationID TrainID Time", stationidx+wsx+trainidx+wsx+timex, &MainProgram::cmd_add_departure, &MainProgram::test_add_departure },
     {"remove_departure", "StationID TrainID Time", stationidx+wsx+trainidx+wsx+timex, &MainProgram::cmd_remove_departure, &MainProgram::test_remove_departure },
     {"station_departures_after", "StationID Time", stationidx+wsx+timex, &MainProgram::cmd_station_departures_after, &MainProgram::test_station_departures_after },
+    {"departures_between", "Time Time", timex+wsx+timex, &MainProgram::cmd_departures_between, &MainProgram::test_departures_between },
+    {"train_stations_from", "StationID TrainID", stationidx+wsx+trainidx, &MainProgram::cmd_train_stations_from, &MainProgram::test_train_stations_from },
+    {"route_earliest_arrival", "StationID StationID Time", stationidx+wsx+stationidx+wsx+timex, &MainProgram::cmd_route_earliest_arrival, &MainProgram::test_route_earliest_arrival },
+    {"stations_reachable_within", "StationID Time Minutes", stationidx+wsx+timex+wsx+numx, &MainProgram::cmd_stations_reachable_within, &MainProgram::test_stations_reachable_within },
+    {"travel_time_matrix", "Time [threads]", timex+"(?:"+wsx+numx+")?", &MainProgram::cmd_travel_time_matrix, nullptr },
+    {"route_shortest_distance", "StationID StationID", stationidx+wsx+stationidx, &MainProgram::cmd_route_shortest_distance, &MainProgram::test_route_shortest_distance },
+    {"route_shortest_distance_dijkstra", "StationID StationID", stationidx+wsx+stationidx, &MainProgram::cmd_route_shortest_distance_dijkstra, &MainProgram::test_route_shortest_distance_dijkstra },
+    {"build_route_hierarchy", "[background]", "(background)?", &MainProgram::cmd_build_route_hierarchy, nullptr },
+    {"route_shortest_distance_hierarchy", "StationID StationID", stationidx+wsx+stationidx, &MainProgram::cmd_route_shortest_distance_hierarchy, &MainProgram::test_route_shortest_distance_hierarchy },
 //    {"mindist", "", "", &MainProgram::NoParstationCmd<&Datastructures::min_distance>, &MainProgram::NoParstationTestCmd<&Datastructures::min_distance> },
 //    {"maxdist", "", "", &MainProgram::NoParstationCmd<&Datastructures::max_distance>, &MainProgram::NoParstationTestCmd<&Datastructures::max_distance> },
     {"add_region", "RegionID \"Name\" (x,y) (x,y)...", regionidx+wsx+'"'+namex+'"'+"((?:"+wsx+optcoordx+")+)", &MainProgram::cmd_add_region, nullptr },
@@ -1139,14 +1704,24 @@ vector<MainProgram::CmdInfo> MainProgram::cmds_ =
     {"add_subregion_to_region", "SubregionID RegionID", regionidx+wsx+regionidx, &MainProgram::cmd_add_subregion_to_region, nullptr },
     {"add_station_to_region", "StationID RegionID", stationidx+wsx+regionidx, &MainProgram::cmd_add_station_to_region, nullptr },
     {"station_in_regions", "StationID", stationidx, &MainProgram::cmd_station_in_regions, &MainProgram::test_station_in_regions },
+    {"stations_in_region", "RegionID", regionidx, &MainProgram::cmd_stations_in_region, &MainProgram::test_stations_in_region },
+    {"region_stats", "RegionID", regionidx, &MainProgram::cmd_region_stats, &MainProgram::test_region_stats },
+    {"region_geometry", "RegionID", regionidx, &MainProgram::cmd_region_geometry, &MainProgram::test_region_geometry },
     {"all_subregions_of_region", "RegionID", regionidx, &MainProgram::cmd_all_subregions_of_region, &MainProgram::test_all_subregions_of_region },
+    {"is_subregion_of", "RegionID ParentRegionID", regionidx+wsx+regionidx, &MainProgram::cmd_is_subregion_of, &MainProgram::test_is_subregion_of },
     {"stations_closest_to", "(x,y)", coordx, &MainProgram::cmd_stations_closest_to, &MainProgram::test_stations_closest_to },
+    {"regions_containing", "(x,y)", coordx, &MainProgram::cmd_regions_containing, &MainProgram::test_regions_containing },
+    {"assign_stations_to_regions", "[threads]", "(?:"+numx+")?", &MainProgram::cmd_assign_stations_to_regions, nullptr },
+    {"polygon_kernel_benchmark", "[points_per_region]", "(?:"+numx+")?", &MainProgram::cmd_polygon_kernel_benchmark, nullptr },
     {"remove_station", "StationID", stationidx, &MainProgram::cmd_remove_station, &MainProgram::test_remove_station },
     {"common_parent_of_regions", "RegionID1 RegionID2", regionidx+wsx+regionidx, &MainProgram::cmd_common_parent_of_regions, &MainProgram::test_common_parent_of_regions },
+    {"common_parents_of_regions", "RegionID1 RegionID2 [RegionID1 RegionID2...]", "([0-9]+"+wsx+"[0-9]+(?:"+wsx+"[0-9]+"+wsx+"[0-9]+)*)",
+     &MainProgram::cmd_common_parents_of_regions, &MainProgram::test_common_parents_of_regions },
     {"quit", "", "", nullptr, nullptr },
     {"help", "", "", &MainProgram::help_command, nullptr },
     {"random_stations", "number_of_stations_to_add  (minx,miny) (maxx,maxy) (coordinates optional)",
      numx+"(?:"+wsx+coordx+wsx+coordx+")?", &MainProgram::cmd_random_stations, &MainProgram::test_random_stations },
+    {"random_trains", "number_of_trains_to_add", numx, &MainProgram::cmd_random_trains, nullptr },
     {"read", "\"in-filename\" [silent]", "\"([-a-zA-Z0-9 ./:_]+)\"(?:"+wsx+"(silent))?", &MainProgram::cmd_read, nullptr },
     {"testread", "\"in-filename\" \"out-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\""+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_testread, nullptr },
     {"perftest", "cmd1|all|compulsory[;cmd2...] timeout repeat_count n1[;n2...] (parts in [] are optional, alternatives separated by |)",
@@ -1176,8 +1751,15 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     try {
     // Note: everything below is indented too little by one indentation level! (because of try block above)
 
-    vector<string> optional_cmds({"remove_station", "all_subregions_of_region", "stations_closest_to", "common_parent_of_regions"});
+    vector<string> optional_cmds({"remove_station", "all_subregions_of_region", "stations_closest_to", "common_parent_of_regions",
+                                  "departures_between", "train_stations_from", "route_earliest_arrival",
+                                  "route_shortest_distance", "route_shortest_distance_dijkstra",
+                                  "route_shortest_distance_hierarchy", "stations_reachable_within", "common_parents_of_regions",
+                                  "is_subregion_of", "stations_in_region", "region_stats", "regions_containing", "region_geometry"});
     vector<string> nondefault_cmds({"all_stations"});
+    // Commands that need trains in addition to the random stations
+    vector<string> train_cmds({"train_stations_from", "route_earliest_arrival", "stations_reachable_within", "route_shortest_distance",
+                               "route_shortest_distance_dijkstra", "route_shortest_distance_hierarchy"});
 
     string commandstr = *begin++;
     unsigned int timeout = convert_string_to<unsigned int>(*begin++);
@@ -1213,6 +1795,10 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 
     // Initialize test functions
     vector<void(MainProgram::*)()> testfuncs;
+    // "all" includes every train command, "compulsory" none of them
+    bool add_trains = commandstr == "all" ||
+                      any_of(testcmds.begin(), testcmds.end(),
+                             [&train_cmds](auto const& cmd){ return find(train_cmds.begin(), train_cmds.end(), cmd) != train_cmds.end(); });
     if (testcmds.empty())
     { // Add all commands
         for (auto& i : cmds_)
@@ -1302,6 +1888,14 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
             stopwatch.stop();
         }
 
+        // One train for every two stations, each stopping at 3-10 nearby stations
+        if (add_trains)
+        {
+            stopwatch.start();
+            add_random_trains(n / 2);
+            stopwatch.stop();
+        }
+
 #ifdef USE_PERF_EVENT
         auto addcount = stopwatch.count();
 #endif
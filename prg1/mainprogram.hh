@@ -22,6 +22,7 @@
 #include <utility>
 #include <variant>
 #include <bitset>
+#include <unordered_map>
 #include <cassert>
 
 #include "datastructures.hh"
@@ -82,6 +83,8 @@ private:
     using CmdResult = std::pair<ResultType, std::variant<CmdResultIDs, CmdResultTrains, CmdResultRoute>>;
     CmdResult prev_result;
     bool view_dirty = true;
+    // Station handles saved by save_station_handle, keyed by the station id they were taken for
+    std::unordered_map<StationID, StationHandle> saved_handles_;
 
     TestStatus test_status_ = TestStatus::NOT_RUN;
 
@@ -111,21 +114,40 @@ private:
     CmdResult cmd_all_stations(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_add_station(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_station_info(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_save_station_handle(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_station_of_saved_handle(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_find_station_with_coord(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_change_station_coord(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_add_departure(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_remove_departure(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_station_departures_after(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_departures_between(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_train_stations_from(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_earliest_arrival(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_stations_reachable_within(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_travel_time_matrix(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_shortest_distance(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_shortest_distance_dijkstra(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_build_route_hierarchy(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_shortest_distance_hierarchy(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_add_region(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_all_regions(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_region_info(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_add_subregion_to_region(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_add_station_to_region(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_station_in_regions(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_stations_in_region(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_region_stats(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_region_geometry(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_all_subregions_of_region(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_is_subregion_of(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_stations_closest_to(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_regions_containing(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_assign_stations_to_regions(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_polygon_kernel_benchmark(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_remove_station(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_common_parent_of_regions(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_common_parents_of_regions(std::ostream& output, MatchIter begin, MatchIter end);
 
     CmdResult help_command(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_randseed(std::ostream& output, MatchIter begin, MatchIter end);
@@ -145,15 +167,30 @@ private:
     void test_add_departure();
     void test_remove_departure();
     void test_station_departures_after();
+    void test_departures_between();
+    void test_train_stations_from();
+    void test_route_earliest_arrival();
+    void test_stations_reachable_within();
+    void test_route_shortest_distance();
+    void test_route_shortest_distance_dijkstra();
+    void test_route_shortest_distance_hierarchy();
     void test_region_info();
     void test_station_in_regions();
+    void test_stations_in_region();
+    void test_region_stats();
+    void test_region_geometry();
     void test_all_subregions_of_region();
+    void test_is_subregion_of();
     void test_stations_closest_to();
+    void test_regions_containing();
     void test_remove_station();
     void test_common_parent_of_regions();
+    void test_common_parents_of_regions();
     void test_random_stations();
 
     void add_random_stations_regions(unsigned int size, Coord min = {1,1}, Coord max = {10000, 10000});
+    void add_random_trains(unsigned int size);
+    CmdResult route_distance_result(std::vector<std::tuple<StationID, TrainID, Distance>> const& route, std::ostream& output);
     Distance calc_distance(Coord c1, Coord c2);
     std::string print_station(StationID id, std::ostream& output, bool nl = true);
     std::string print_station_brief(StationID id, std::ostream& output, bool nl = true);
@@ -19,7 +19,7 @@
 
 QT       += core gui
 
-CONFIG += c++17 warn_on
+CONFIG += c++17 warn_on thread
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 